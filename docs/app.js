@@ -21,13 +21,35 @@
   const colorsRange = document.getElementById('colors');
   const colorsVal = document.getElementById('colorsVal');
   const invertChk = document.getElementById('invert');
+  const whiteRange = document.getElementById('white');
+  const whiteVal = document.getElementById('whiteVal');
+  const denoiseRange = document.getElementById('denoise');
+  const denoiseVal = document.getElementById('denoiseVal');
+  const ditherChk = document.getElementById('dither');
+  const ditherBiasRange = document.getElementById('ditherBias');
+  const ditherBiasVal = document.getElementById('ditherBiasVal');
   const sizeRange = document.getElementById('sizeRange');
   const sizeVal = document.getElementById('sizeVal');
   const downloadBtn = document.getElementById('downloadBtn');
   const downloadPreviewBtn = document.getElementById('downloadPreviewBtn');
+  const exportProgress = document.getElementById('exportProgress');
   const undoBtn = document.getElementById('undoBtn');
   const redoBtn = document.getElementById('redoBtn');
   const binSizeEl = document.getElementById('binSize');
+  const hotspotBtn = document.getElementById('hotspotBtn');
+  const hotspotList = document.getElementById('hotspotList');
+  const budgetInput = document.getElementById('budget');
+  const budgetLineInput = document.getElementById('budgetLine');
+  const fitBtn = document.getElementById('fitBtn');
+  const fitReport = document.getElementById('fitReport');
+  const costMapChk = document.getElementById('costMap');
+  const costCsvBtn = document.getElementById('costCsvBtn');
+  const costReport = document.getElementById('costReport');
+  const deviceBtn = document.getElementById('deviceBtn');
+  const deviceModal = document.getElementById('deviceModal');
+  const deviceCanvas = document.getElementById('deviceCanvas');
+  const deviceInfo = document.getElementById('deviceInfo');
+  const deviceClose = document.getElementById('deviceClose');
 
   const octx = orig.getContext('2d');
   const pctx = prev.getContext('2d');
@@ -59,8 +81,6 @@
 
   let img = new Image();
   let state = {w:orig.width,h:orig.height,angle:0};
-  const history = [];
-  let redoStack = [];
   let initialIntrinsic = null; // store initial file dimensions (never overwritten)
   let originalIntrinsic = null; // store current image intrinsic (updated on edits)
   let originalFileSize = null;
@@ -68,102 +88,342 @@
   // hide preview on startup (show when image is loaded)
   if(prev) prev.classList.add('hidden');
 
-  // --- Session persistence (localStorage) ---
-  const SESSION_KEY = 'highImage:lastSession';
+  // --- Edit history: operations replayed from the loaded file ---
+  // Every edit is an operation on the image (crop, rotate, flip) or a change
+  // of the encoding settings. Undo and redo replay the image operations from
+  // the last keyframe before the target (a PNG of the image, taken every
+  // KEYFRAME_EVERY image operations) or from the file itself, so memory holds
+  // the file, the log and at most KEYFRAME_MAX keyframes however long the
+  // session.
+  const KEYFRAME_EVERY = 8;
+  const KEYFRAME_MAX = 4;
+  let source = null;       // Blob of the loaded file
+  let baseSettings = null; // settings when it was loaded
+  let ops = [];            // the first opCount are applied, the rest can be redone
+  let opCount = 0;
+  let keyframes = [];      // { pos, key, blob }: the image after ops[0..pos)
+  let replaying = false;
+  let settingsPending = false; // settings changed during a replay, recorded after it
+  let imageUrl = null;     // object URL behind img
+
+  function isImageOp(op){ return op.type !== 'settings'; }
+
+  function currentSettings(){
+    return {
+      colors: colorsRange.value,
+      size: sizeRange ? sizeRange.value : null,
+      invert: invertChk.checked,
+      white: whiteRange ? whiteRange.value : null,
+      denoise: denoiseRange ? denoiseRange.value : null,
+      dither: ditherChk ? ditherChk.checked : false,
+      ditherBias: ditherBiasRange ? ditherBiasRange.value : null
+    };
+  }
 
-  function saveSession(){
-    try{
-      if(!orig) return;
-      // Prepare lightweight copies of history and redo stacks to avoid blowing localStorage
-      function serializeStack(stack){
-        try{
-          if(!Array.isArray(stack) || stack.length===0) return [];
-          const max = 6; // keep only last 6 states
-          const out = [];
-          for(let i=Math.max(0, stack.length-max); i<stack.length; i++){
-            const it = stack[i];
-            if(!it || !it.src) continue;
-            // only include reasonably-sized data URLs (skip huge ones)
-            // allow larger threshold because we store as JPEG where possible
-            if(it.src.length > 900000) continue;
-            out.push({ src: it.src, w: it.w, h: it.h, originalIntrinsic: it.originalIntrinsic });
-          }
-          return out;
-        }catch(e){ return []; }
-      }
+  function applySettings(s){
+    if(!s) return;
+    if(s.colors) colorsRange.value = s.colors;
+    colorsVal.textContent = colorsRange.value;
+    if(sizeRange && s.size) sizeRange.value = s.size;
+    if(sizeVal) sizeVal.textContent = sizeRange ? sizeRange.value : '4';
+    invertChk.checked = !!s.invert;
+    if(whiteRange && s.white) whiteRange.value = s.white;
+    if(denoiseRange && s.denoise != null) denoiseRange.value = s.denoise;
+    if(ditherChk) ditherChk.checked = !!s.dither;
+    if(ditherBiasRange && s.ditherBias != null) ditherBiasRange.value = s.ditherBias;
+    updateFilterLabels();
+  }
 
-      const data = {
-        // use JPEG for session image to reduce size and increase chance of saving
-        image: (function(){ try{ return orig.toDataURL('image/jpeg', 0.8); }catch(e){ return orig.toDataURL(); } })(),
-        state: { w: state.w, h: state.h },
-        originalIntrinsic: originalIntrinsic,
-        colors: colorsRange ? colorsRange.value : null,
-          size: sizeRange ? sizeRange.value : null,
-        invert: invertChk ? invertChk.checked : false,
-        history: serializeStack(history),
-        redoStack: serializeStack(redoStack),
-        timestamp: Date.now()
-      };
-      try{
-        localStorage.setItem(SESSION_KEY, JSON.stringify(data));
-      }catch(e){
-        // If storage quota exceeded, attempt a smaller save without stacks
-        const small = { image: data.image, state: data.state, originalIntrinsic: data.originalIntrinsic, colors: data.colors, invert: data.invert, timestamp: data.timestamp };
-        try{ localStorage.setItem(SESSION_KEY, JSON.stringify(small)); }catch(e2){ /* give up */ }
+  // settings in effect once ops[0..pos) are applied
+  function settingsAt(pos){
+    for(let i=pos-1;i>=0;i--) if(ops[i].type === 'settings') return ops[i].settings;
+    return baseSettings;
+  }
+
+  // The image after op, on a new canvas, from src drawn at w x h.
+  function applyOp(src, w, h, op){
+    const tmp = document.createElement('canvas');
+    const tctx = tmp.getContext('2d');
+    if(op.type === 'rotate90'){
+      tmp.width = h; tmp.height = w;
+      tctx.translate(tmp.width/2,tmp.height/2);
+      tctx.rotate(Math.PI/2);
+      tctx.drawImage(src, -w/2, -h/2, w, h);
+    }else if(op.type === 'flipH'){
+      tmp.width = w; tmp.height = h;
+      tctx.translate(w, 0);
+      tctx.scale(-1, 1);
+      tctx.drawImage(src, 0, 0, w, h);
+    }else if(op.type === 'flipV'){
+      tmp.width = w; tmp.height = h;
+      tctx.translate(0, h);
+      tctx.scale(1, -1);
+      tctx.drawImage(src, 0, 0, w, h);
+    }else if(op.type === 'crop'){
+      tmp.width = op.w; tmp.height = op.h;
+      tctx.drawImage(src, op.x, op.y, op.w, op.h, 0, 0, op.w, op.h);
+    }else if(op.type === 'rotate'){
+      // rotate by any angle, then keep the largest upright rectangle inside
+      const rad = op.angle * Math.PI / 180;
+      const turned = document.createElement('canvas');
+      turned.width = Math.ceil(Math.abs(w * Math.cos(rad)) + Math.abs(h * Math.sin(rad)));
+      turned.height = Math.ceil(Math.abs(w * Math.sin(rad)) + Math.abs(h * Math.cos(rad)));
+      const rctx = turned.getContext('2d');
+      rctx.translate(turned.width / 2, turned.height / 2);
+      rctx.rotate(rad);
+      rctx.drawImage(src, -w / 2, -h / 2, w, h);
+      const rect = largestRotatedRect(w, h, rad);
+      tmp.width = rect.width; tmp.height = rect.height;
+      tctx.drawImage(turned, Math.floor((turned.width - rect.width) / 2), Math.floor((turned.height - rect.height) / 2),
+                     rect.width, rect.height, 0, 0, rect.width, rect.height);
+    }
+    return tmp;
+  }
+
+  // Makes the blob the current image; done(img) once it is drawn, fail()
+  // if it cannot be decoded.
+  function showBlob(blob, done, fail){
+    const url = URL.createObjectURL(blob);
+    const next = new Image();
+    next.onload = ()=>{
+      if(imageUrl) URL.revokeObjectURL(imageUrl);
+      imageUrl = url;
+      img = next;
+      state.w = next.naturalWidth || next.width;
+      state.h = next.naturalHeight || next.height;
+      sel = null;
+      originalIntrinsic = { w: state.w, h: state.h };
+      drawImageToOrig();
+      updatePreview();
+      if(prev) prev.classList.remove('hidden');
+      if(done) done(next);
+    };
+    next.onerror = ()=>{ URL.revokeObjectURL(url); if(fail) fail(); };
+    next.src = url;
+  }
+
+  function showCanvas(c, done, fail){
+    c.toBlob(blob => {
+      if(!blob){ if(fail) fail(); return; }
+      showBlob(blob, ()=>{ if(done) done(blob); }, fail);
+    }, 'image/png');
+  }
+
+  // Image edits wait for the replay to end: their buttons are disabled
+  // meanwhile, and a settings change is recorded once it is over.
+  function setReplaying(on){
+    replaying = on;
+    [rotateBtn, rotateCustomBtn, flipHBtn, flipVBtn, cropBtn, cropConfirm, rotateConfirm, undoBtn, redoBtn]
+      .forEach(b => { if(b) b.disabled = on; });
+  }
+
+  function endReplay(failed){
+    setReplaying(false);
+    if(failed) alert("Impossible d'afficher l'image, rien n'a changé");
+    if(settingsPending){ settingsPending = false; recordSettings(); }
+    else saveSession();
+  }
+
+  function blobImage(blob){
+    return new Promise((resolve, reject) => {
+      const url = URL.createObjectURL(blob);
+      const im = new Image();
+      im.onload = ()=>{ URL.revokeObjectURL(url); resolve(im); };
+      im.onerror = ()=>{ URL.revokeObjectURL(url); reject(new Error('decode')); };
+      im.src = url;
+    });
+  }
+
+  // the image once ops[0..pos) are applied, as a canvas
+  function imageAt(pos){
+    let kf = null;
+    for(const k of keyframes) if(k.pos <= pos && (!kf || k.pos > kf.pos)) kf = k;
+    return blobImage(kf ? kf.blob : source).then(im => {
+      let cur = im, w = im.naturalWidth || im.width, h = im.naturalHeight || im.height;
+      for(let i = kf ? kf.pos : 0; i < pos; i++){
+        if(!isImageOp(ops[i])) continue;
+        cur = applyOp(cur, w, h, ops[i]);
+        w = cur.width; h = cur.height;
+      }
+      if(cur === im){
+        cur = document.createElement('canvas');
+        cur.width = w; cur.height = h;
+        cur.getContext('2d').drawImage(im, 0, 0, w, h);
       }
-    }catch(e){ /* ignore */ }
+      return cur;
+    });
   }
 
-  function loadSession(){
-    try{
-      const raw = localStorage.getItem(SESSION_KEY);
-      if(!raw) return false;
-      const data = JSON.parse(raw);
-      if(!data || !data.image) return false;
-      img = new Image();
-      img.onload = ()=>{
-        // restore state from saved canvas image
-        state.w = data.state && data.state.w ? data.state.w : img.width;
-        state.h = data.state && data.state.h ? data.state.h : img.height;
-        originalIntrinsic = data.originalIntrinsic || { w: state.w, h: state.h };
-        sel = null;
-        history.length = 0;
-        // restore history/redo stacks if present
-        try{
-          if(Array.isArray(data.history)){
-            history.push(...data.history);
-          }
-          if(Array.isArray(data.redoStack)){
-            redoStack.push(...data.redoStack);
-          }
-        }catch(e){}
-        drawImageToOrig();
-        if(colorsRange && data.colors) colorsRange.value = data.colors;
-        if(colorsVal) colorsVal.textContent = colorsRange.value;
-        if(sizeRange && data.size) sizeRange.value = data.size;
-        if(sizeVal) sizeVal.textContent = sizeRange ? sizeRange.value : '4';
-        if(invertChk) invertChk.checked = !!data.invert;
-        updatePreview();
-        if(prev) prev.classList.remove('hidden');
+  // Keeps the image after ops[0..opCount) as a keyframe when the last one
+  // is KEYFRAME_EVERY image operations back.
+  function maybeKeyframe(blob){
+    let since = 0;
+    const last = keyframes.length ? keyframes[keyframes.length-1].pos : 0;
+    for(let i=last;i<opCount;i++) if(isImageOp(ops[i])) since++;
+    if(since < KEYFRAME_EVERY) return;
+    const k = { pos: opCount, key: 'keyframe:' + opCount + ':' + Date.now(), blob: blob };
+    keyframes.push(k);
+    putBlob(k.key, blob).catch(()=>{});
+    while(keyframes.length > KEYFRAME_MAX) deleteBlob(keyframes.shift().key).catch(()=>{});
+  }
+
+  // Appends op to the log, dropping what could be redone.
+  function pushOp(op){
+    ops.length = opCount;
+    keyframes = keyframes.filter(k => {
+      if(k.pos <= opCount) return true;
+      deleteBlob(k.key).catch(()=>{});
+      return false;
+    });
+    ops.push(op);
+    opCount = ops.length;
+  }
+
+  // Applies a new operation to the current image; it enters the log once
+  // the new image is shown.
+  function commitOp(op){
+    if(!img.src) return;
+    if(!isImageOp(op)){ pushOp(op); saveSession(); return; }
+    if(replaying) return;
+    setReplaying(true);
+    showCanvas(applyOp(img, state.w, state.h, op), blob => {
+      pushOp(op);
+      maybeKeyframe(blob);
+      endReplay(false);
+    }, ()=> endReplay(true));
+  }
+
+  // Records a change of the encoding settings, once the slider is let go.
+  function recordSettings(){
+    if(replaying){ settingsPending = true; return; }
+    const s = currentSettings();
+    const before = settingsAt(opCount);
+    if(!img.src || (before && JSON.stringify(before) === JSON.stringify(s))){ saveSession(); return; }
+    commitOp({ type: 'settings', settings: s });
+  }
+
+  // Moves to after ops[0..pos): settings at once, the image by replay when an
+  // image operation lies in between. The position moves once the image is
+  // shown; if it cannot be, the settings go back to what they were.
+  function restoreTo(pos){
+    const from = opCount, fromSettings = currentSettings();
+    applySettings(settingsAt(pos));
+    const between = ops.slice(Math.min(from, pos), Math.max(from, pos));
+    if(!between.some(isImageOp)){ opCount = pos; updatePreview(); saveSession(); return; }
+    setReplaying(true);
+    const done = ()=>{ opCount = pos; endReplay(false); };
+    const fail = ()=>{ applySettings(fromSettings); updatePreview(); endReplay(true); };
+    if(pos === from + 1){
+      showCanvas(applyOp(img, state.w, state.h, ops[from]), done, fail);
+      return;
+    }
+    imageAt(pos).then(c => showCanvas(c, done, fail), fail);
+  }
+
+  // --- Session persistence (IndexedDB) ---
+  // The 'session' store holds one small record (settings, log, hotspots);
+  // the 'blobs' store the file and the keyframes, written once each.
+  const DB_NAME = 'highImage';
+  const SESSION_KEY = 'highImage:lastSession'; // localStorage, before IndexedDB
+  let dbPromise = null;
+
+  function openDb(){
+    if(!dbPromise) dbPromise = new Promise((resolve, reject) => {
+      if(!window.indexedDB) return reject(new Error('no IndexedDB'));
+      const req = indexedDB.open(DB_NAME, 1);
+      req.onupgradeneeded = ()=>{
+        req.result.createObjectStore('session');
+        req.result.createObjectStore('blobs');
       };
-      img.src = data.image;
-      return true;
-    }catch(e){ return false; }
+      req.onsuccess = ()=> resolve(req.result);
+      req.onerror = ()=> reject(req.error);
+    });
+    return dbPromise;
   }
 
-  function clearSession(){ localStorage.removeItem(SESSION_KEY); }
+  // fn(store) in a transaction; resolves to the result of the request it returns
+  function dbRequest(store, mode, fn){
+    return openDb().then(db => new Promise((resolve, reject) => {
+      const tx = db.transaction(store, mode);
+      const req = fn(tx.objectStore(store));
+      tx.oncomplete = ()=> resolve(req ? req.result : undefined);
+      tx.onerror = ()=> reject(tx.error);
+      tx.onabort = ()=> reject(tx.error);
+    }));
+  }
+  function putBlob(key, blob){ return dbRequest('blobs', 'readwrite', st => st.put(blob, key)); }
+  function deleteBlob(key){ return dbRequest('blobs', 'readwrite', st => st.delete(key)); }
+  function getBlob(key){ return dbRequest('blobs', 'readonly', st => st.get(key)); }
 
-  function pushHistory(){
-    try{
-      if(!img.src) return;
-      // use JPEG output for history to reduce data URL size for localStorage
-      var dataUrl;
-      try{ dataUrl = orig.toDataURL('image/jpeg', 0.8); }catch(e){ dataUrl = orig.toDataURL(); }
-      history.push({src: dataUrl, w: state.w, h: state.h, originalIntrinsic: originalIntrinsic});
-      // push a new state clears the redo stack
-      redoStack.length = 0;
-      if(history.length>12) history.shift();
-    }catch(e){/* ignore */}
+  function saveSession(){
+    if(!source || replaying) return;
+    const data = {
+      settings: currentSettings(),
+      baseSettings: baseSettings,
+      ops: ops,
+      opCount: opCount,
+      keyframes: keyframes.map(k => ({ pos: k.pos, key: k.key })),
+      hotspots: hotspots,
+      timestamp: Date.now()
+    };
+    dbRequest('session', 'readwrite', st => st.put(data, 'last')).catch(()=>{ /* ignore */ });
+  }
+
+  // Makes blob the source of a new log and stores it; settings as they are.
+  function openSource(blob, done){
+    showBlob(blob, im => {
+      originalIntrinsic = { w: state.w, h: state.h };
+      if(!initialIntrinsic) initialIntrinsic = { w: state.w, h: state.h };
+      state.angle = 0;
+      source = blob;
+      ops = [];
+      opCount = 0;
+      keyframes = [];
+      baseSettings = currentSettings();
+      dbRequest('blobs', 'readwrite', st => { st.clear(); return st.put(blob, 'source'); })
+        .then(saveSession, ()=>{});
+      if(done) done(im);
+    });
+  }
+
+  // Resolves to whether a session was restored.
+  function loadSession(){
+    return dbRequest('session', 'readonly', st => st.get('last')).then(data => {
+      if(!data) return loadLegacySession();
+      return getBlob('source').then(blob => {
+        if(!blob) return false;
+        source = blob;
+        ops = Array.isArray(data.ops) ? data.ops : [];
+        opCount = Math.min(data.opCount || 0, ops.length);
+        baseSettings = data.baseSettings || null;
+        return Promise.all((data.keyframes || []).map(k => getBlob(k.key).then(b => b ? { pos: k.pos, key: k.key, blob: b } : null)))
+          .then(list => {
+            keyframes = list.filter(Boolean);
+            return imageAt(opCount);
+          })
+          .then(c => new Promise(resolve => {
+            applySettings(data.settings || settingsAt(opCount));
+            hotspots = Array.isArray(data.hotspots) ? data.hotspots.slice(0, HOTSPOT_MAX) : [];
+            showCanvas(c, ()=> resolve(true), ()=> resolve(false));
+          }));
+      });
+    }).catch(()=> loadLegacySession());
+  }
+
+  // A session saved in localStorage by earlier versions: its image becomes
+  // the source of a new log.
+  function loadLegacySession(){
+    let data = null;
+    try{ data = JSON.parse(localStorage.getItem(SESSION_KEY)); }catch(e){}
+    if(!data || !data.image) return Promise.resolve(false);
+    return fetch(data.image).then(r => r.blob()).then(blob => new Promise(resolve => {
+      applySettings(data);
+      hotspots = Array.isArray(data.hotspots) ? data.hotspots.slice(0, HOTSPOT_MAX) : [];
+      openSource(blob, ()=>{
+        try{ localStorage.removeItem(SESSION_KEY); }catch(e){}
+        resolve(true);
+      });
+    })).catch(()=> false);
   }
 
   // selection for crop
@@ -232,29 +492,7 @@
     const f = e.target.files && e.target.files[0];
     if(!f) return;
     originalFileSize = f.size;
-    const url = URL.createObjectURL(f);
-    img = new Image();
-    img.onload = ()=>{
-      // capture intrinsic size from original file load
-      originalIntrinsic = { w: img.naturalWidth || img.width, h: img.naturalHeight || img.height };
-      if(!initialIntrinsic) initialIntrinsic = { w: originalIntrinsic.w, h: originalIntrinsic.h };
-      // use actual image dimensions without constraining
-      state.w = originalIntrinsic.w;
-      state.h = originalIntrinsic.h;
-      state.angle = 0;
-      sel = null;
-      history.length = 0;
-      pushHistory();
-      drawImageToOrig();
-      updatePreview();
-      // show preview (was hidden on startup)
-      if(prev) prev.classList.remove('hidden');
-      // clear redo stack on new load
-      redoStack.length = 0;
-      // save session after loading new file
-      saveSession();
-    };
-    img.src = url;
+    openSource(f);
   });
 
   // toolbar interactions
@@ -401,43 +639,21 @@
       const oy = Math.max(0, Math.floor(modalSel.y / modalScale));
       const ow = Math.max(1, Math.floor(modalSel.w / modalScale));
       const oh = Math.max(1, Math.floor(modalSel.h / modalScale));
-      pushHistory();
-      const tmp = document.createElement('canvas'); tmp.width = ow; tmp.height = oh;
-      tmp.getContext('2d').drawImage(orig, ox, oy, ow, oh, 0,0, ow, oh);
-      img = new Image(); img.onload = ()=>{ state.w = tmp.width; state.h = tmp.height; sel=null; originalIntrinsic = {w: tmp.width, h: tmp.height}; drawImageToOrig(); updatePreview(); cropModal.setAttribute('aria-hidden','true'); };
-      img.src = tmp.toDataURL();
-      // save session after crop
-      setTimeout(saveSession, 50);
+      commitOp({ type: 'crop', x: ox, y: oy, w: ow, h: oh });
+      cropModal.setAttribute('aria-hidden','true');
     });
   }
 
   rotateBtn.addEventListener('click', ()=>{
     // rotate 90° clockwise
-    pushHistory();
-    const tmp = document.createElement('canvas');
-    tmp.width = state.h; tmp.height = state.w;
-    const tctx = tmp.getContext('2d');
-    tctx.translate(tmp.width/2,tmp.height/2);
-    tctx.rotate(Math.PI/2);
-    tctx.drawImage(orig, -state.w/2, -state.h/2);
-    img = new Image(); img.onload = ()=>{ state.w = tmp.width; state.h = tmp.height; sel=null; originalIntrinsic = {w: tmp.width, h: tmp.height}; drawImageToOrig(); updatePreview(); }; img.src = tmp.toDataURL();
-    // save session after rotate
-    setTimeout(saveSession, 50);
+    commitOp({ type: 'rotate90' });
   });
 
   // flip horizontal
   if(flipHBtn){
     flipHBtn.addEventListener('click', ()=>{
       if(!img.src) return alert('Chargez une image avant de retourner');
-      pushHistory();
-      const tmp = document.createElement('canvas');
-      tmp.width = state.w; tmp.height = state.h;
-      const tctx = tmp.getContext('2d');
-      tctx.translate(tmp.width, 0);
-      tctx.scale(-1, 1);
-      tctx.drawImage(orig, 0, 0);
-      img = new Image(); img.onload = ()=>{ sel=null; originalIntrinsic = {w: tmp.width, h: tmp.height}; drawImageToOrig(); updatePreview(); }; img.src = tmp.toDataURL();
-      setTimeout(saveSession, 50);
+      commitOp({ type: 'flipH' });
     });
   }
 
@@ -445,15 +661,7 @@
   if(flipVBtn){
     flipVBtn.addEventListener('click', ()=>{
       if(!img.src) return alert('Chargez une image avant de retourner');
-      pushHistory();
-      const tmp = document.createElement('canvas');
-      tmp.width = state.w; tmp.height = state.h;
-      const tctx = tmp.getContext('2d');
-      tctx.translate(0, tmp.height);
-      tctx.scale(1, -1);
-      tctx.drawImage(orig, 0, 0);
-      img = new Image(); img.onload = ()=>{ sel=null; originalIntrinsic = {w: tmp.width, h: tmp.height}; drawImageToOrig(); updatePreview(); }; img.src = tmp.toDataURL();
-      setTimeout(saveSession, 50);
+      commitOp({ type: 'flipV' });
     });
   }
 
@@ -566,76 +774,125 @@ if (rotateConfirm) {
       return;
     }
 
-    pushHistory();
-
-    const rad = angle * Math.PI / 180;
-    const w = state.w;
-    const h = state.h;
-
-    const tmp = document.createElement('canvas');
-
-    const absW = Math.abs(w * Math.cos(rad)) + Math.abs(h * Math.sin(rad));
-    const absH = Math.abs(w * Math.sin(rad)) + Math.abs(h * Math.cos(rad));
-
-    tmp.width = Math.ceil(absW);
-    tmp.height = Math.ceil(absH);
-
-    const tctx = tmp.getContext('2d');
-    tctx.translate(tmp.width / 2, tmp.height / 2);
-    tctx.rotate(rad);
-    tctx.drawImage(orig, -w / 2, -h / 2);
+    commitOp({ type: 'rotate', angle: angle });
+    rotateModal.setAttribute('aria-hidden','true');
+  });
+}
 
-    const rect = largestRotatedRect(w, h, rad);
+  // reset button removed from UI; no-op kept for compatibility.
 
-    const cropW = rect.width;
-    const cropH = rect.height;
+  colorsRange.addEventListener('input', ()=>{ colorsVal.textContent = colorsRange.value; showQuickSize(); schedulePreview(); });
+  invertChk.addEventListener('change', updatePreview);
+  // palette/invert changes go to the edit log and the session
+  if(colorsRange) colorsRange.addEventListener('change', recordSettings);
+  if(invertChk) invertChk.addEventListener('change', recordSettings);
+  if(sizeRange){
+    sizeRange.addEventListener('input', ()=>{ if(sizeVal) sizeVal.textContent = sizeRange.value; schedulePreview(); });
+    sizeRange.addEventListener('change', recordSettings);
+  }
+  if(ditherChk) ditherChk.addEventListener('change', ()=>{ updatePreview(); recordSettings(); });
+  [whiteRange, denoiseRange, ditherBiasRange].forEach(el => {
+    if(!el) return;
+    el.addEventListener('input', ()=>{ updateFilterLabels(); if(el === whiteRange) showQuickSize(); schedulePreview(); });
+    el.addEventListener('change', recordSettings);
+  });
 
-    const offsetX = Math.floor((tmp.width - cropW) / 2);
-    const offsetY = Math.floor((tmp.height - cropH) / 2);
+  function updateFilterLabels(){
+    if(whiteVal && whiteRange) whiteVal.textContent = whiteRange.value >= 256 ? 'off' : whiteRange.value;
+    if(denoiseVal && denoiseRange) denoiseVal.textContent = denoiseRange.value;
+    if(ditherBiasVal && ditherBiasRange) ditherBiasVal.textContent = ditherBiasRange.value + '%';
+  }
 
-    const cropped = document.createElement('canvas');
-    cropped.width = cropW;
-    cropped.height = cropH;
+  function whiteLevel(){ return whiteRange ? parseInt(whiteRange.value,10) : 256; }
+  function denoiseLevel(){ return denoiseRange ? parseInt(denoiseRange.value,10) : 0; }
+  // run bias in level steps, or -1 without dithering
+  function ditherBias(){
+    if(!ditherChk || !ditherChk.checked) return -1;
+    return ditherBiasRange ? parseInt(ditherBiasRange.value,10)/100 : 0.75;
+  }
 
-    cropped.getContext('2d').drawImage(
-      tmp,
-      offsetX, offsetY, cropW, cropH,
-      0, 0, cropW, cropH
-    );
+  // Lengthens runs along a row of level indices, as denoise() in
+  // python/main.py: a pixel between two equal neighbours takes their value,
+  // then from level 2 so do two equal pixels. Each pass reads the row as it
+  // was before it.
+  function denoiseRow(row, level){
+    if(level < 1) return;
+    let src = row.slice();
+    for(let x=1; x<row.length-1; x++){
+      if(src[x-1] === src[x+1] && src[x] !== src[x-1]) row[x] = src[x-1];
+    }
+    if(level < 2) return;
+    src = row.slice();
+    for(let x=1; x<row.length-2; x++){
+      if(src[x-1] === src[x+2] && src[x] === src[x+1] && src[x] !== src[x-1]){
+        row[x] = row[x+1] = src[x-1];
+      }
+    }
+  }
 
-    img = new Image();
-    img.onload = () => {
-      state.w = cropped.width;
-      state.h = cropped.height;
-      sel = null;
-      originalIntrinsic = { w: cropped.width, h: cropped.height };
-      drawImageToOrig();
-      updatePreview();
-      rotateModal.setAttribute('aria-hidden','true');
-      // save session after custom rotate+crop applied
-      setTimeout(saveSession, 50);
-    };
+  // Note: preview and output are now based on tiles of 320×240 (see updatePreview)
 
-    img.src = cropped.toDataURL();
-  });
-}
+  // Slider drags fire faster than a large preview renders: redraw at most
+  // once per frame.
+  let previewFrame = 0;
+  function schedulePreview(){
+    if(previewFrame) return;
+    previewFrame = requestAnimationFrame(()=>{ previewFrame = 0; updatePreview(); });
+  }
 
-  // reset button removed from UI; no-op kept for compatibility.
+  // Binary size of the preview, kept by updatePreview() from the levels it
+  // computes anyway: the bytes of every 320-pixel segment, and the runs of
+  // equal intensity (before the white threshold) of every segment, with
+  // which a change of colors or white alone is costed without the pixels.
+  const sizeCache = {
+    w: 0, h: 0, cols: 0,
+    segBytes: new Uint16Array(0), pixelBytes: 0,
+    runValue: new Uint8Array(0), runLength: new Uint16Array(0), segFirstRun: new Uint32Array(1)
+  };
+
+  // Room for `more` runs past the first `used`, doubling as it grows.
+  function reserveRuns(used, more){
+    const cap = sizeCache.runValue.length;
+    if(used + more <= cap) return;
+    const size = Math.max(used + more, cap * 2);
+    const value = new Uint8Array(size), length = new Uint16Array(size);
+    value.set(sizeCache.runValue.subarray(0, used));
+    length.set(sizeCache.runLength.subarray(0, used));
+    sizeCache.runValue = value;
+    sizeCache.runLength = length;
+  }
 
-  colorsRange.addEventListener('input', ()=>{ colorsVal.textContent = colorsRange.value; updatePreview(); });
-  invertChk.addEventListener('change', updatePreview);
-  // save palette/invert changes to session
-  if(colorsRange) colorsRange.addEventListener('change', saveSession);
-  if(invertChk) invertChk.addEventListener('change', saveSession);
-  if(sizeRange){
-    sizeRange.addEventListener('input', ()=>{ if(sizeVal) sizeVal.textContent = sizeRange.value; updatePreview(); });
-    sizeRange.addEventListener('change', saveSession);
+  // Pixel bytes of the last preview with other colors and white, from the
+  // cached runs, or -1 when denoise or dithering make a pixel depend on its
+  // neighbours. Invert never changes the size.
+  function quickPixelBytes(ncolors, white){
+    if(!sizeCache.w || denoiseLevel() > 0 || ditherBias() >= 0) return -1;
+    const lut = new Uint8Array(256);
+    for(let v=0; v<256; v++) lut[v] = Math.round((v >= white ? 255 : v)/255*(ncolors-1));
+    const value = sizeCache.runValue, length = sizeCache.runLength, first = sizeCache.segFirstRun;
+    const segs = sizeCache.h * sizeCache.cols;
+    let bytes = 0;
+    for(let s=0; s<segs; s++){
+      let cur = -1, run = 0;
+      for(let r=first[s]; r<first[s+1]; r++){
+        const v = lut[value[r]];
+        if(v === cur){ run += length[r]; continue; }
+        bytes += (run + 15) >> 4;
+        cur = v; run = length[r];
+      }
+      bytes += (run + 15) >> 4;
+    }
+    return bytes;
   }
 
-  // Note: preview and output are now based on tiles of 320×240 (see updatePreview)
+  function showQuickSize(){
+    const bytes = quickPixelBytes(parseInt(colorsRange.value,10), whiteLevel());
+    if(bytes >= 0 && binSizeEl) binSizeEl.textContent = humanFileSize(bytes + trailerSize());
+  }
 
   function updatePreview(){
     if(!img.src) return;
+    if(previewFrame){ cancelAnimationFrame(previewFrame); previewFrame = 0; }
     // render a preview for export (internal size) according to sizeRange (tiles of 320x240)
     const mult = sizeRange ? Math.max(1, Math.min(12, parseInt(sizeRange.value,10)||4)) : 4;
     const W = 320 * mult, H = 240 * mult;
@@ -647,14 +904,51 @@ if (rotateConfirm) {
     // quantize pixel data
     const data = pctx.getImageData(0,0,prev.width,prev.height);
     const ncolors = parseInt(colorsRange.value,10);
-    for(let i=0;i<data.data.length;i+=4){
-      const r=data.data[i], g=data.data[i+1], b=data.data[i+2];
-      let intensity = Math.round((r+g+b)/3);
-      let idx = Math.round(intensity/255*(ncolors-1));
-      if(invertChk.checked) idx = (ncolors-1)-idx;
-      const gray = Math.round(idx/(ncolors-1)*255);
-      data.data[i]=data.data[i+1]=data.data[i+2]=gray;
+    const white = whiteLevel(), denoise = denoiseLevel(), bias = ditherBias();
+    const row = new Uint8Array(W);
+    const dither = bias >= 0 ? makeDither(W, ncolors, white, bias) : null;
+    const cols = W / 320;
+    if(sizeCache.segBytes.length !== H * cols) sizeCache.segBytes = new Uint16Array(H * cols);
+    if(sizeCache.segFirstRun.length !== H * cols + 1) sizeCache.segFirstRun = new Uint32Array(H * cols + 1);
+    const segBytes = sizeCache.segBytes, segFirstRun = sizeCache.segFirstRun;
+    let runs = 0, pixelBytes = 0;
+    for(let y=0;y<H;y++){
+      reserveRuns(runs, W);
+      const runValue = sizeCache.runValue, runLength = sizeCache.runLength;
+      for(let x=0;x<W;x++){
+        const i = (y*W + x)*4;
+        const r=data.data[i], g=data.data[i+1], b=data.data[i+2];
+        let intensity = Math.round((r+g+b)/3);
+        if(x % 320 === 0){
+          segFirstRun[y*cols + x/320] = runs;
+          runValue[runs] = intensity; runLength[runs++] = 1;
+        }else if(intensity === runValue[runs-1]) runLength[runs-1]++;
+        else{ runValue[runs] = intensity; runLength[runs++] = 1; }
+        if(intensity >= white) intensity = 255;
+        row[x] = Math.round(intensity/255*(ncolors-1));
+      }
+      if(dither) dither(data.data, y, row);
+      if(invertChk.checked) for(let x=0;x<W;x++) row[x] = (ncolors-1)-row[x];
+      denoiseRow(row, denoise);
+      for(let x=0;x<W;x++){
+        const i = (y*W + x)*4;
+        const gray = Math.round(row[x]/(ncolors-1)*255);
+        data.data[i]=data.data[i+1]=data.data[i+2]=gray;
+      }
+      // levels map one to one to palette indices, so their runs are the file's
+      for(let s=0;s<cols;s++){
+        let bytes = 0, cur = -1, run = 0;
+        for(let x=s*320;x<(s+1)*320;x++){
+          if(row[x] === cur && run < 16){ run++; }
+          else{ bytes++; cur = row[x]; run = 1; }
+        }
+        segBytes[y*cols + s] = bytes;
+        pixelBytes += bytes;
+      }
     }
+    segFirstRun[H*cols] = runs;
+    sizeCache.w = W; sizeCache.h = H; sizeCache.cols = cols;
+    sizeCache.pixelBytes = pixelBytes;
     pctx.putImageData(data,0,0);
 
     // compute display scale to fit previewWrap without overflowing
@@ -712,6 +1006,8 @@ if (rotateConfirm) {
     if(binSizeEl) binSizeEl.textContent = humanFileSize(size);
     // update preview size badge (internal canvas size)
     try { if(previewSizeEl) previewSizeEl.textContent = prev.width + '×' + prev.height; } catch(e) {}
+    renderHotspots();
+    renderCostMap();
   }
 
   // recalc preview display on window resize
@@ -726,36 +1022,452 @@ if (rotateConfirm) {
     return bytes.toFixed(1)+' '+units[u];
   }
 
+  function trailerSize(){
+    return hotspots.length * HOTSPOT_RECORD_SIZE + 8;
+  }
+
+  // exact size of the exported file for the last preview drawn
   function computeBinarySize(){
     if(!img.src) return 0;
-    const ncolors = parseInt(colorsRange.value,10);
-    const invert = invertChk.checked;
-    const w = prev.width, h = prev.height;
-    const imgd = pctx.getImageData(0,0,w,h).data;
-    let size = 0;
-    for(let y=0;y<h;y++){
-      for(let xChunk=0;xChunk<w;xChunk+=320){
-        const xEnd = Math.min(xChunk+320,w);
-        let cur = Math.round(imgd[(y*w + xChunk)*4]/255*(ncolors-1));
-        if(invert) cur = (ncolors-1)-cur;
-        cur = Math.round(cur/(ncolors-1)*15);
-        let run = 1;
-        for(let x = xChunk+1; x<xEnd; x++){
-          let v = Math.round(imgd[(y*w + x)*4]/255*(ncolors-1));
-          if(invert) v = (ncolors-1)-v;
-          v = Math.round(v/(ncolors-1)*15);
-          if(v === cur && run < 16){ run++; }
-          else{ size++; cur = v; run = 1; }
+    return sizeCache.pixelBytes + trailerSize();
+  }
+
+  // Cost map: the bytes of every 320-pixel segment of the preview tinted over
+  // it, and the bytes the viewer walks to draw each view at the scale it
+  // opens with (every 4th pixel of 1280x960), as python/main.py --heatmap
+  // reports them. A blank segment (runs of 16) is not tinted, the costliest
+  // is tinted COST_TINT red.
+  const VIEW_SCALE = 4;
+  const COST_TINT = 0.8;
+  const COST_FLOOR = 320 / 16;
+  let costCanvas = null;
+
+  // origins along one axis of the views tiling it, the last clamped to the edge
+  function viewOrigins(size, screen){
+    const last = Math.max(0, size - screen * VIEW_SCALE);
+    const out = [];
+    for(let v=0; v<last; v+=screen*VIEW_SCALE) out.push(v);
+    out.push(last);
+    return out;
+  }
+
+  // bytes walked per view: for each screen row, its source row's segments
+  // under the view, the last one counted whole
+  function viewCosts(){
+    const { h, cols, segBytes } = sizeCache;
+    const costs = [];
+    for(const vy of viewOrigins(h, 240)){
+      for(const vx of viewOrigins(cols * 320, 320)){
+        const c0 = Math.floor(vx / 320), c1 = Math.min(cols, Math.floor((vx + 319 * VIEW_SCALE) / 320) + 1);
+        let bytes = 0;
+        for(let j=0; j<240; j++){
+          const y = vy + VIEW_SCALE * j;
+          if(y >= h) break;
+          for(let c=c0; c<c1; c++) bytes += segBytes[y*cols + c];
         }
-        if(run>0) size++;
+        costs.push({ x: vx, y: vy, bytes: bytes });
       }
     }
-    return size;
+    return costs;
   }
 
-  // download binary with RLE per Python spec
-  downloadBtn.addEventListener('click', ()=>{
-    if(!img.src) return alert('Chargez et appliquez la palette (bouton Apply)');
+  function renderCostMap(){
+    if(!costMapChk || !costMapChk.checked || !img.src || !sizeCache.w || prev.classList.contains('hidden')){
+      if(costCanvas){ costCanvas.remove(); costCanvas = null; }
+      if(costReport) costReport.textContent = '';
+      return;
+    }
+    const { h, cols, segBytes } = sizeCache;
+    let full = COST_FLOOR + 1;
+    for(let i=0; i<segBytes.length; i++) if(segBytes[i] > full) full = segBytes[i];
+    // one pixel per segment and row, stretched over the preview
+    if(!costCanvas){
+      costCanvas = document.createElement('canvas');
+      costCanvas.className = 'cost-map';
+    }
+    costCanvas.width = cols; costCanvas.height = h;
+    const cctx = costCanvas.getContext('2d');
+    const map = cctx.createImageData(cols, h);
+    for(let i=0; i<segBytes.length; i++){
+      map.data[i*4] = 255;
+      map.data[i*4+3] = Math.round(255 * COST_TINT * Math.max(0, segBytes[i] - COST_FLOOR) / (full - COST_FLOOR));
+    }
+    cctx.putImageData(map, 0, 0);
+    const pr = prev.getBoundingClientRect(), wr = previewWrap.getBoundingClientRect();
+    costCanvas.style.left = (pr.left - wr.left) + 'px';
+    costCanvas.style.top = (pr.top - wr.top) + 'px';
+    costCanvas.style.width = pr.width + 'px';
+    costCanvas.style.height = pr.height + 'px';
+    previewWrap.appendChild(costCanvas);
+
+    if(!costReport) return;
+    const lines = ['Reddest: ' + full + ' o per 320 px', 'Bytes per 240-row band, by column:'];
+    for(let y0=0; y0<h; y0+=240){
+      const band = new Array(cols).fill(0);
+      for(let y=y0; y<Math.min(y0+240, h); y++) for(let c=0; c<cols; c++) band[c] += segBytes[y*cols + c];
+      lines.push(y0 + ': ' + band.join(' ') + ' = ' + band.reduce((a, b) => a + b, 0));
+    }
+    const costs = viewCosts();
+    const worst = costs.reduce((a, b) => b.bytes > a.bytes ? b : a);
+    lines.push('Decode per view at scale ' + VIEW_SCALE + ' (x, y: bytes):');
+    costs.forEach(v => lines.push(v.x + ', ' + v.y + ': ' + v.bytes + (v === worst ? ' <' : '')));
+    costReport.textContent = lines.join('\n');
+  }
+
+  if(costMapChk) costMapChk.addEventListener('change', renderCostMap);
+  if(costCsvBtn){
+    costCsvBtn.addEventListener('click', ()=>{
+      if(!img.src || !sizeCache.w) return alert('Chargez une image');
+      const { h, cols, segBytes } = sizeCache;
+      const rows = ['row,' + Array.from({ length: cols }, (_, c) => 'col' + c).join(',')];
+      for(let y=0; y<h; y++) rows.push(y + ',' + Array.from(segBytes.subarray(y*cols, (y+1)*cols)).join(','));
+      const blob = new Blob([rows.join('\n') + '\n'], { type: 'text/csv' });
+      const url = URL.createObjectURL(blob);
+      const a = document.createElement('a'); a.href = url; a.download = 'cost.csv'; a.click();
+      setTimeout(() => URL.revokeObjectURL(url), 1000);
+    });
+  }
+
+  // hotspots: named rectangles of the output that the calculator jumps to
+  // with keys 1-9. Kept as fractions of the preview so they follow a change
+  // of tile count. Layout of the trailer matches python/main.py.
+  const HOTSPOT_MAX = 9;
+  const HOTSPOT_NAME_LEN = 16;
+  const HOTSPOT_RECORD_SIZE = HOTSPOT_NAME_LEN + 12 + 240 * 4;
+  let hotspots = [];
+  let hotspotMode = false;
+  let hotspotStart = null;
+  let hotspotDraft = null;
+
+  // viewer position {x, y, zoom4} showing a hotspot, clamped like the viewer
+  function hotspotView(spot, W, H){
+    const x = Math.round(spot.fx * W), y = Math.round(spot.fy * H);
+    const w = Math.round(spot.fw * W), h = Math.round(spot.fh * H);
+    const maxZoom4 = Math.max(4, Math.floor(Math.min(W / 320, H / 240) * 4));
+    const zoom = spot.zoom || Math.max(w / 320, h / 240);
+    const zoom4 = Math.min(Math.max(Math.ceil(zoom * 4), 4), maxZoom4);
+    const scale = zoom4 / 4;
+    let vx = Math.floor(x + w / 2 - 160 * scale);
+    let vy = Math.floor(y + h / 2 - 120 * scale);
+    vx = Math.max(0, Math.min(vx, Math.max(0, W - Math.ceil(320 * scale))));
+    vy = Math.max(0, Math.min(vy, Math.max(0, H - Math.ceil(240 * scale))));
+    return { x: vx, y: vy, zoom4: zoom4 };
+  }
+
+  // trailer recording the layout (320px segments per row) and the hotspots
+  function encodeTrailer(rowOffsets, W, H){
+    const n = Math.min(hotspots.length, HOTSPOT_MAX);
+    const buf = new Uint8Array(n * HOTSPOT_RECORD_SIZE + 8);
+    const dv = new DataView(buf.buffer);
+    for(let i=0;i<n;i++){
+      const base = i * HOTSPOT_RECORD_SIZE;
+      const name = new TextEncoder().encode(hotspots[i].name || '');
+      // keep the name NUL-terminated and cut on a character boundary
+      let len = Math.min(name.length, HOTSPOT_NAME_LEN - 1);
+      while(len > 0 && len < name.length && (name[len] & 0xC0) === 0x80) len--;
+      buf.set(name.subarray(0, len), base);
+      const v = hotspotView(hotspots[i], W, H);
+      dv.setUint32(base + 16, v.x, true);
+      dv.setUint32(base + 20, v.y, true);
+      dv.setUint16(base + 24, v.zoom4, true);
+      for(let s=0;s<240;s++){
+        const sy = Math.floor(v.y + s * v.zoom4 / 4);
+        dv.setUint32(base + 28 + s*4, sy < H ? rowOffsets[sy] : 0xFFFFFFFF, true);
+      }
+    }
+    const foot = n * HOTSPOT_RECORD_SIZE;
+    dv.setUint16(foot, n, true);
+    dv.setUint16(foot + 2, W / 320, true);
+    buf.set([0x43, 0x53, 0x48, 0x53], foot + 4); // "CSHS"
+    return buf;
+  }
+
+  function hotspotBox(cls, fx, fy, fw, fh){
+    const pr = prev.getBoundingClientRect();
+    const wr = previewWrap.getBoundingClientRect();
+    const el = document.createElement('div');
+    el.className = cls;
+    el.style.left = (pr.left - wr.left + fx * pr.width) + 'px';
+    el.style.top = (pr.top - wr.top + fy * pr.height) + 'px';
+    el.style.width = (fw * pr.width) + 'px';
+    el.style.height = (fh * pr.height) + 'px';
+    previewWrap.appendChild(el);
+    return el;
+  }
+
+  function renderHotspots(){
+    if(!previewWrap) return;
+    previewWrap.querySelectorAll('.hotspot-box').forEach(el => el.remove());
+    if(hotspotList) hotspotList.innerHTML = '';
+    hotspots.forEach((spot, i) => {
+      if(img.src && !prev.classList.contains('hidden')){
+        const box = hotspotBox('hotspot-box', spot.fx, spot.fy, spot.fw, spot.fh);
+        box.textContent = (i+1) + ' ' + spot.name;
+      }
+      if(!hotspotList) return;
+      const li = document.createElement('li');
+      li.textContent = spot.name + (spot.zoom ? ' ×' + spot.zoom : '');
+      const del = document.createElement('button');
+      del.textContent = '✕';
+      del.title = 'Remove hotspot';
+      del.addEventListener('click', ()=>{ hotspots.splice(i, 1); renderHotspots(); updatePreview(); saveSession(); });
+      li.appendChild(del);
+      hotspotList.appendChild(li);
+    });
+    if(hotspotBtn) hotspotBtn.disabled = hotspots.length >= HOTSPOT_MAX;
+  }
+
+  if(hotspotBtn){
+    hotspotBtn.addEventListener('click', ()=>{
+      if(!img.src) return alert('Chargez une image');
+      hotspotMode = true;
+      prev.style.cursor = 'cell';
+    });
+    prev.addEventListener('mousedown', e=>{
+      if(!hotspotMode) return;
+      e.preventDefault();
+      const p = clientToCanvasPreview(e.clientX, e.clientY);
+      hotspotStart = { x: p.x / prev.width, y: p.y / prev.height };
+      hotspotDraft = hotspotBox('hotspot-box draft', hotspotStart.x, hotspotStart.y, 0, 0);
+    });
+    window.addEventListener('mousemove', e=>{
+      if(!hotspotStart || !hotspotDraft) return;
+      const p = clientToCanvasPreview(e.clientX, e.clientY);
+      const fx = Math.max(0, Math.min(1, p.x / prev.width)), fy = Math.max(0, Math.min(1, p.y / prev.height));
+      hotspotDraft.remove();
+      hotspotDraft = hotspotBox('hotspot-box draft', Math.min(fx, hotspotStart.x), Math.min(fy, hotspotStart.y),
+                               Math.abs(fx - hotspotStart.x), Math.abs(fy - hotspotStart.y));
+    });
+    window.addEventListener('mouseup', e=>{
+      if(!hotspotStart) return;
+      const p = clientToCanvasPreview(e.clientX, e.clientY);
+      const fx = Math.max(0, Math.min(1, p.x / prev.width)), fy = Math.max(0, Math.min(1, p.y / prev.height));
+      const spot = { fx: Math.min(fx, hotspotStart.x), fy: Math.min(fy, hotspotStart.y),
+                     fw: Math.abs(fx - hotspotStart.x), fh: Math.abs(fy - hotspotStart.y) };
+      hotspotStart = null;
+      if(hotspotDraft){ hotspotDraft.remove(); hotspotDraft = null; }
+      hotspotMode = false;
+      prev.style.cursor = '';
+      // cancel too-small selections
+      if(spot.fw * prev.width < 4 || spot.fh * prev.height < 4) return;
+      const name = prompt('Hotspot name', 'Hotspot ' + (hotspots.length + 1));
+      if(name === null) return;
+      const zoom = parseFloat(prompt('Zoom (1 = full detail, empty = fit the rectangle)', '') || '');
+      spot.name = name;
+      spot.zoom = zoom >= 1 ? Math.round(zoom * 4) / 4 : 0;
+      hotspots.push(spot);
+      updatePreview();
+      saveSession();
+    });
+  }
+
+  // Byte budget, as python/main.py --budget: the colors, white threshold,
+  // denoise level and tile count (at most the current one) that fit a file
+  // size, and optionally a largest line (the decode cost of a screen row),
+  // with the lowest mean grey error against the preview at the current tile
+  // count. Fewer tiles are not tried once full quality fits or once their
+  // scaling loss alone is above the best error found, and a tile count is
+  // skipped when even the coarsest settings do not fit.
+  const BUDGET_LEVELS = [16, 12, 8, 6, 4, 3, 2];
+  const BUDGET_WHITE = [256, 240, 224];
+  const BUDGET_DENOISE = [0, 1, 2];
+  const BUDGET_COARSEST = { levels: 2, white: 224, denoise: 2 };
+
+  // intensities (rounded (r+g+b)/3) of the original drawn at mult tiles
+  function budgetIntensities(mult){
+    const W = 320 * mult, H = 240 * mult;
+    const c = document.createElement('canvas');
+    c.width = W; c.height = H;
+    const ctx = c.getContext('2d');
+    ctx.drawImage(orig, 0, 0, state.w, state.h, 0, 0, W, H);
+    const d = ctx.getImageData(0, 0, W, H).data;
+    const out = new Uint8Array(W * H);
+    for(let p=0, i=0; p<out.length; p++, i+=4) out[p] = Math.round((d[i]+d[i+1]+d[i+2])/3);
+    return { W: W, H: H, data: out };
+  }
+
+  // mean distance between the reference and img blown back up to its size
+  function budgetScaleLoss(ref, img){
+    if(img.W === ref.W) return 0;
+    let sum = 0;
+    for(let y=0; y<ref.H; y++){
+      const sy = Math.floor(y * img.H / ref.H);
+      for(let x=0; x<ref.W; x++){
+        sum += Math.abs(img.data[sy * img.W + Math.floor(x * img.W / ref.W)] - ref.data[y * ref.W + x]);
+      }
+    }
+    return sum / (ref.W * ref.H);
+  }
+
+  // {bytes, line, error} of the pixel data exported with settings s; the
+  // error is against the grey the calculator shows for each palette index
+  function budgetMeasure(img, s){
+    const lut = new Uint8Array(256);
+    for(let v=0; v<256; v++) lut[v] = Math.round((v >= s.white ? 255 : v)/255*(s.levels-1));
+    const row = new Uint8Array(img.W);
+    let bytes = 0, line = 0, error = 0;
+    for(let y=0; y<img.H; y++){
+      const base = y * img.W;
+      for(let x=0; x<img.W; x++) row[x] = lut[img.data[base + x]];
+      denoiseRow(row, s.denoise);
+      for(let xChunk=0; xChunk<img.W; xChunk+=320){
+        let n = 1, run = 1;
+        for(let x=xChunk+1; x<xChunk+320; x++){
+          if(row[x] === row[x-1] && run < 16) run++;
+          else { n++; run = 1; }
+        }
+        bytes += n;
+        if(n > line) line = n;
+      }
+      for(let x=0; x<img.W; x++){
+        error += Math.abs(Math.round(row[x]/(s.levels-1)*15) * 17 - img.data[base + x]);
+      }
+    }
+    return { bytes: bytes, line: line, error: error / (img.W * img.H) };
+  }
+
+  function fitBudget(budget, maxLine){
+    const trailer = hotspots.length * HOTSPOT_RECORD_SIZE + 8;
+    const fits = m => m.bytes + trailer <= budget && (!maxLine || m.line <= maxLine);
+    const top = sizeRange ? parseInt(sizeRange.value,10) : 4;
+    const ref = budgetIntensities(top);
+    let best = null;
+    const sizes = [];
+    for(let mult=top; mult>=1; mult--){
+      const img = mult === top ? ref : budgetIntensities(mult);
+      const loss = budgetScaleLoss(ref, img);
+      if(best && loss >= best.m.error) break;
+      if(!fits(budgetMeasure(img, BUDGET_COARSEST))){ sizes.push({ mult: mult, fit: 0 }); continue; }
+      let fit = 0, fullFits = false, bestHere = null;
+      for(const levels of BUDGET_LEVELS) for(const white of BUDGET_WHITE) for(const denoise of BUDGET_DENOISE){
+        const s = { levels: levels, white: white, denoise: denoise };
+        const m = budgetMeasure(img, s);
+        m.error += loss;
+        if(!fits(m)) continue;
+        fit++;
+        if(levels === 16 && white === 256 && denoise === 0) fullFits = true;
+        if(!bestHere || m.error < bestHere.m.error || (m.error === bestHere.m.error && m.bytes < bestHere.m.bytes)){
+          bestHere = { s: s, m: m, mult: mult };
+        }
+      }
+      sizes.push({ mult: mult, fit: fit, error: bestHere ? bestHere.m.error : null });
+      if(bestHere && (!best || bestHere.m.error < best.m.error)) best = bestHere;
+      if(fullFits) break;
+    }
+    return { best: best, sizes: sizes, trailer: trailer, count: BUDGET_LEVELS.length * BUDGET_WHITE.length * BUDGET_DENOISE.length };
+  }
+
+  if(fitBtn){
+    fitBtn.addEventListener('click', ()=>{
+      if(!img.src) return alert('Chargez une image');
+      const budget = Math.floor(parseFloat(budgetInput.value) * 1024);
+      if(!(budget > 0)) return alert('Budget ?');
+      const maxLine = parseInt(budgetLineInput.value, 10) || 0;
+      fitReport.textContent = 'Searching…';
+      // let the message paint before the search blocks
+      setTimeout(()=>{
+        const r = fitBudget(budget, maxLine);
+        const lines = r.sizes.map(z => z.mult + ' tiles: ' + z.fit + '/' + r.count + ' fit' +
+                                  (z.error != null ? ', error ' + z.error.toFixed(2) : '') +
+                                  (r.best && z.mult === r.best.mult ? ' <' : ''));
+        if(!r.best){
+          fitReport.textContent = 'Nothing fits, even at 1 tile.\n' + lines.join('\n');
+          return;
+        }
+        const s = r.best.s, m = r.best.m;
+        colorsRange.value = s.levels;
+        colorsVal.textContent = s.levels;
+        if(whiteRange) whiteRange.value = s.white;
+        if(denoiseRange) denoiseRange.value = s.denoise;
+        // the search measures thresholds only
+        if(ditherChk) ditherChk.checked = false;
+        if(sizeRange) sizeRange.value = r.best.mult;
+        if(sizeVal) sizeVal.textContent = r.best.mult;
+        updateFilterLabels();
+        updatePreview();
+        recordSettings();
+        fitReport.textContent = s.levels + ' colors, white ' + (s.white >= 256 ? 'off' : 'from ' + s.white) +
+          ', denoise ' + s.denoise + ', ' + r.best.mult + ' tiles: ' + humanFileSize(m.bytes + r.trailer) +
+          ', line ' + m.line + ' o max, mean error ' + m.error.toFixed(2) + '/255\n' + lines.join('\n');
+      }, 20);
+    });
+  }
+
+  // Export: the preview is quantised and RLE-encoded in bands of rows by a
+  // few workers (docs/export-worker.js), in place if they cannot start; the
+  // file is the bands' bytes in order, then the trailer.
+  const EXPORT_BAND_ROWS = 240;
+  const EXPORT_MAX_WORKERS = 4;
+  let exporting = false;
+
+  function showExportProgress(done, total){
+    if(!exportProgress) return;
+    exportProgress.classList.toggle('hidden', done >= total);
+    exportProgress.max = total;
+    exportProgress.value = done;
+  }
+
+  // Resolves to the encoded bands, { data, length, rowBytes } each, in order.
+  function encodeBands(rgba, w, h, ncolors, invert){
+    const count = Math.ceil(h / EXPORT_BAND_ROWS);
+    const bandOf = b => {
+      const y0 = b * EXPORT_BAND_ROWS, rows = Math.min(EXPORT_BAND_ROWS, h - y0);
+      return { rows: rows, start: y0 * w * 4, end: (y0 + rows) * w * 4 };
+    };
+    const inPlace = () => new Promise(resolve => {
+      const bands = [];
+      const step = () => {
+        const band = bandOf(bands.length);
+        bands.push(encodeBand(rgba.subarray(band.start, band.end), w, band.rows, ncolors, invert));
+        showExportProgress(bands.length, count);
+        if(bands.length < count) setTimeout(step, 0); else resolve(bands);
+      };
+      step();
+    });
+    let workers;
+    try{
+      const n = Math.max(1, Math.min(EXPORT_MAX_WORKERS, navigator.hardwareConcurrency || 2, count));
+      workers = [];
+      for(let i=0;i<n;i++) workers.push(new Worker('export-worker.js'));
+    }catch(e){
+      if(workers) workers.forEach(wk => wk.terminate());
+      return inPlace();
+    }
+    return new Promise(resolve => {
+      const bands = new Array(count);
+      let next = 0, done = 0, failed = false;
+      const send = wk => {
+        if(next >= count) return;
+        const b = next++, band = bandOf(b);
+        const copy = rgba.slice(band.start, band.end);
+        wk.postMessage({ band: b, rgba: copy.buffer, w: w, rows: band.rows, ncolors: ncolors, invert: invert }, [copy.buffer]);
+      };
+      workers.forEach(wk => {
+        wk.onmessage = e => {
+          const m = e.data;
+          bands[m.band] = { data: new Uint8Array(m.data), length: m.length, rowBytes: new Uint32Array(m.rowBytes) };
+          showExportProgress(++done, count);
+          if(done === count){
+            workers.forEach(x => x.terminate());
+            resolve(bands);
+          }else send(wk);
+        };
+        wk.onerror = e => {
+          e.preventDefault();
+          if(failed) return;
+          failed = true;
+          workers.forEach(x => x.terminate());
+          inPlace().then(resolve);
+        };
+        send(wk);
+      });
+    });
+  }
+
+  // The file "Export .bin" writes for the current preview: resolves to
+  // { parts, pixelBytes, rowOffsets, w, h }, the bands of pixel bytes then
+  // the trailer.
+  function encodeSheet(){
     // build palette quantization parameters
     const ncolors = parseInt(colorsRange.value,10);
     const invert = invertChk.checked;
@@ -763,46 +1475,183 @@ if (rotateConfirm) {
     updatePreview();
     const w = prev.width, h = prev.height;
     const imgd = pctx.getImageData(0,0,w,h).data;
-    const indices = [];
-    for(let y=0;y<h;y++){
-      for(let x=0;x<w;x++){
-        const i = (y*w + x)*4;
-        const intensity = imgd[i]; // already gray
-        let idx = Math.round(intensity/255*(ncolors-1));
-        if(invert) idx = (ncolors-1)-idx;
-        // map to 0..15 scale (since palette indices expected 0..15)
-        const mapped = Math.round(idx/(ncolors-1)*15);
-        indices.push(mapped & 0x0F);
-      }
-    }
-
-    // RLE encode per row, chunked by 320 pixels
-    const out = [];
-    for(let y=0;y<h;y++){
-      for(let xChunk=0;xChunk<w;xChunk+=320){
-        const xEnd = Math.min(xChunk+320,w);
-        // process this chunk
-        let cur = indices[y*w + xChunk];
-        let run = 1;
-        for(let x = xChunk+1; x<xEnd; x++){
-          const v = indices[y*w + x];
-          if(v === cur && run < 16){ run++; }
-          else{
-            out.push(((run-1)&0x0F)<<4 | (cur&0x0F));
-            cur = v; run = 1;
-          }
+    showExportProgress(0, Math.ceil(h / EXPORT_BAND_ROWS));
+    return encodeBands(imgd, w, h, ncolors, invert).then(bands => {
+      const rowOffsets = [];
+      const parts = [];
+      let offset = 0;
+      for(const band of bands){
+        for(let y=0;y<band.rowBytes.length;y++){
+          rowOffsets.push(offset);
+          offset += band.rowBytes[y];
         }
-        if(run>0){ out.push(((run-1)&0x0F)<<4 | (cur&0x0F)); }
+        parts.push(band.data.subarray(0, band.length));
       }
-    }
+      parts.push(encodeTrailer(rowOffsets, w, h));
+      return { parts: parts, pixelBytes: offset, rowOffsets: rowOffsets, w: w, h: h };
+    });
+  }
 
-    const u8 = new Uint8Array(out);
-    const blob = new Blob([u8],{type:'application/octet-stream'});
-    const url = URL.createObjectURL(blob);
-    const a = document.createElement('a'); a.href = url; a.download = 'input.bin'; a.click();
-    URL.revokeObjectURL(url);
+  downloadBtn.addEventListener('click', ()=>{
+    if(!img.src) return alert('Chargez et appliquez la palette (bouton Apply)');
+    if(exporting) return;
+    exporting = true;
+    downloadBtn.disabled = true;
+    encodeSheet().then(sheet => {
+      const blob = new Blob(sheet.parts,{type:'application/octet-stream'});
+      const url = URL.createObjectURL(blob);
+      const a = document.createElement('a'); a.href = url; a.download = 'input.bin'; a.click();
+      setTimeout(() => URL.revokeObjectURL(url), 1000);
+    }).finally(() => {
+      exporting = false;
+      downloadBtn.disabled = false;
+    });
   });
 
+  // Device view: the exported file drawn as the calculator draws a settled
+  // view, floor() sampling of the runs at quarter-step scales, with the
+  // calculator's navigation: arrows (or drag) pan, + and - zoom, 1 to 9 open
+  // the hotspots. The rows are drawn by docs/device.js.
+  const DEVICE_QUANTUM = 4;     // pans move by multiples of 4 screen pixels, as in src/app.c
+  const DEVICE_PAN = 10;        // quanta per arrow press
+  let device = null;            // the open sheet and its view
+  let deviceFrameReq = 0;
+  let deviceDrag = null;
+  const dctx = deviceCanvas ? deviceCanvas.getContext('2d') : null;
+  const deviceImage = dctx ? dctx.createImageData(320, 240) : null;
+
+  // keeps the view on the sheet, as src/app.c does after every key
+  function deviceClamp(d){
+    const maxX = Math.max(0, d.w - Math.ceil(320 * d.scale));
+    const maxY = Math.max(0, d.h - Math.ceil(240 * d.scale));
+    d.x = Math.max(0, Math.min(d.x, maxX));
+    d.y = Math.max(0, Math.min(d.y, maxY));
+  }
+
+  function deviceDraw(){
+    deviceFrameReq = 0;
+    const d = device;
+    if(!d || !dctx) return;
+    for(let sy=0; sy<240; sy++) deviceRenderRow(d, sy);
+    const px = deviceImage.data;
+    for(let i=0; i<320*240; i++){
+      const c = d.frame[i], r = c >> 11, g = (c >> 5) & 0x3F, b = c & 0x1F;
+      px[i*4] = r << 3 | r >> 2;
+      px[i*4+1] = g << 2 | g >> 4;
+      px[i*4+2] = b << 3 | b >> 2;
+      px[i*4+3] = 255;
+    }
+    dctx.putImageData(deviceImage, 0, 0);
+    if(deviceInfo) deviceInfo.textContent = d.x + ', ' + d.y + ' ×' + d.scale;
+  }
+
+  function deviceRedraw(){
+    if(!deviceFrameReq) deviceFrameReq = requestAnimationFrame(deviceDraw);
+  }
+
+  // zoom_step() of src/app.c: quarter steps about the centre of the view
+  function deviceZoom(delta){
+    const d = device;
+    const cx = d.x + 320 * d.scale / 2, cy = d.y + 240 * d.scale / 2;
+    const scale = Math.max(1, Math.min(d.scale + delta, d.maxScale));
+    if(scale === d.scale) return;
+    d.scale = scale;
+    d.x = Math.floor(cx - 320 * scale / 2);
+    d.y = Math.floor(cy - 240 * scale / 2);
+    deviceClamp(d);
+    deviceRedraw();
+  }
+
+  // pan by screen pixels, in whole quanta; returns what was left over
+  function devicePan(dx, dy){
+    const d = device;
+    const quantum = Math.floor(DEVICE_QUANTUM * d.scale + 0.5);
+    const qx = Math.trunc(dx * d.scale / quantum), qy = Math.trunc(dy * d.scale / quantum);
+    d.x += qx * quantum;
+    d.y += qy * quantum;
+    deviceClamp(d);
+    if(qx || qy) deviceRedraw();
+    return { x: dx - qx * quantum / d.scale, y: dy - qy * quantum / d.scale };
+  }
+
+  function closeDevice(){
+    deviceModal.setAttribute('aria-hidden', 'true');
+    device = null;
+    deviceDrag = null;
+  }
+
+  if(deviceBtn && deviceModal && dctx){
+    deviceBtn.addEventListener('click', ()=>{
+      if(!img.src) return alert('Chargez une image');
+      if(exporting) return;
+      exporting = true;
+      deviceBtn.disabled = true;
+      if(deviceInfo) deviceInfo.textContent = '…';
+      encodeSheet().then(sheet => {
+        const total = sheet.parts.reduce((n, p) => n + p.length, 0);
+        const data = new Uint8Array(total);
+        let o = 0;
+        for(const part of sheet.parts){ data.set(part, o); o += part.length; }
+        const cols = sheet.w / 320;
+        // opens at the calculator's first view
+        device = {
+          data: data, pixelBytes: sheet.pixelBytes, w: sheet.w, h: sheet.h, cols: cols,
+          segOffsets: deviceSegments(data, sheet.pixelBytes, sheet.rowOffsets, cols),
+          frame: new Uint16Array(320 * 240),
+          x: 0, y: 0, scale: 4, maxScale: Math.max(1, Math.min(sheet.w / 320, sheet.h / 240))
+        };
+        deviceModal.setAttribute('aria-hidden', 'false');
+        deviceCanvas.focus();
+        deviceRedraw();
+      }).finally(() => {
+        exporting = false;
+        deviceBtn.disabled = false;
+      });
+    });
+    if(deviceClose) deviceClose.addEventListener('click', closeDevice);
+    deviceModal.querySelector('.modal-backdrop').addEventListener('click', closeDevice);
+
+    window.addEventListener('keydown', e=>{
+      if(!device) return;
+      const arrows = { ArrowLeft: [-1, 0], ArrowRight: [1, 0], ArrowUp: [0, -1], ArrowDown: [0, 1] };
+      if(arrows[e.key]){
+        const step = DEVICE_PAN * DEVICE_QUANTUM;
+        devicePan(arrows[e.key][0] * step, arrows[e.key][1] * step);
+      }else if(e.key === '+' || e.key === '='){
+        deviceZoom(-0.25);
+      }else if(e.key === '-'){
+        deviceZoom(0.25);
+      }else if(e.key >= '1' && e.key <= '9' && hotspots[e.key - 1]){
+        const v = hotspotView(hotspots[e.key - 1], device.w, device.h);
+        device.x = v.x; device.y = v.y;
+        device.scale = Math.max(1, Math.min(v.zoom4 / 4, device.maxScale));
+        deviceClamp(device);
+        deviceRedraw();
+      }else if(e.key === 'Escape'){
+        closeDevice();
+      }else return;
+      e.preventDefault();
+    });
+    deviceCanvas.addEventListener('wheel', e=>{
+      if(!device) return;
+      e.preventDefault();
+      deviceZoom(e.deltaY > 0 ? 0.25 : -0.25);
+    }, { passive: false });
+    deviceCanvas.addEventListener('mousedown', e=>{
+      if(device) deviceDrag = { x: e.clientX, y: e.clientY, rest: { x: 0, y: 0 } };
+    });
+    window.addEventListener('mousemove', e=>{
+      if(!deviceDrag || !device) return;
+      // client pixels to screen pixels of the 320-wide canvas
+      const k = 320 / deviceCanvas.getBoundingClientRect().width;
+      const dx = (deviceDrag.x - e.clientX) * k + deviceDrag.rest.x;
+      const dy = (deviceDrag.y - e.clientY) * k + deviceDrag.rest.y;
+      deviceDrag.x = e.clientX; deviceDrag.y = e.clientY;
+      deviceDrag.rest = devicePan(dx, dy);
+    });
+    window.addEventListener('mouseup', ()=>{ deviceDrag = null; });
+  }
+
   downloadPreviewBtn.addEventListener('click', ()=>{
     if(!img.src) return alert('Chargez une image');
     prev.toBlob(blob=>{
@@ -844,46 +1693,21 @@ if (rotateConfirm) {
   }
 
   undoBtn.addEventListener('click', ()=>{
-    if(history.length<=0) return;
-    // save current state to redo
-    try{ if(img.src) redoStack.push({src: orig.toDataURL(), w: state.w, h: state.h, originalIntrinsic: originalIntrinsic}); }catch(e){}
-    const last = history.pop();
-    if(!last) return;
-    img = new Image();
-    img.onload = ()=>{
-      state.w = last.w;
-      state.h = last.h;
-      if(last.originalIntrinsic) originalIntrinsic = last.originalIntrinsic;
-      sel=null; drawImageToOrig(); updatePreview();
-      // save session after undo
-      setTimeout(saveSession, 50);
-    };
-    img.src = last.src;
+    if(opCount <= 0 || replaying) return;
+    restoreTo(opCount - 1);
   });
 
   if(redoBtn){
     redoBtn.addEventListener('click', ()=>{
-      if(redoStack.length<=0) return;
-      // save current state to history (so undo remains possible)
-      try{ if(img.src) history.push({src: orig.toDataURL(), w: state.w, h: state.h, originalIntrinsic: originalIntrinsic}); }catch(e){}
-      const next = redoStack.pop();
-      if(!next) return;
-      img = new Image();
-      img.onload = ()=>{
-        state.w = next.w;
-        state.h = next.h;
-        if(next.originalIntrinsic) originalIntrinsic = next.originalIntrinsic;
-        sel = null; drawImageToOrig(); updatePreview();
-        // save session after redo
-        setTimeout(saveSession, 50);
-      };
-      img.src = next.src;
+      if(opCount >= ops.length || replaying) return;
+      restoreTo(opCount + 1);
     });
   }
 
   // initially
+  updateFilterLabels();
   // try restore last session; fall back to initial preview
-  if(!loadSession()) updatePreview();
+  loadSession().then(ok => { if(!ok) updatePreview(); });
 
   // ensure we persist on unload too
   window.addEventListener('beforeunload', ()=>{ try{ saveSession(); }catch(e){} });
@@ -0,0 +1,55 @@
+// Rows of the device view of the web editor, drawn from the runs of an
+// exported sheet as src/viewer.c draws a settled view: deviceRenderRow() is
+// a port of render_source_row(). Loaded by the page before app.js, and kept
+// apart so python/check_device.py can run it against the host viewer.
+
+const DEVICE_PALETTE = new Uint16Array([0x0000,0x1082,0x2104,0x3186,0x4228,0x52AA,0x632C,0x73AE,
+                                        0x8C51,0x9CD3,0xAD55,0xBDD7,0xCE79,0xDE7B,0xEF7D,0xFFFF]);
+const DEVICE_WHITE = 0xFFFF;
+
+// offset of every 320-pixel segment of the sheet
+function deviceSegments(data, pixelBytes, rowOffsets, cols){
+  const seg = new Uint32Array(rowOffsets.length * cols);
+  for(let y=0; y<rowOffsets.length; y++){
+    let i = rowOffsets[y];
+    for(let c=0; c<cols; c++){
+      seg[y*cols + c] = i;
+      for(let px=0; px<320 && i<pixelBytes; ) px += (data[i++] >> 4) + 1;
+    }
+  }
+  return seg;
+}
+
+// screen row sy of the view, straight from the runs as render_source_row()
+// samples them: screen pixel x shows source pixel floor(x * scale + view_x)
+function deviceRenderRow(d, sy){
+  const row = d.frame.subarray(sy * 320, sy * 320 + 320);
+  const y = Math.floor(d.y + sy * d.scale);
+  if(y < 0 || y >= d.h){ row.fill(DEVICE_WHITE); return; }
+  const data = d.data, scale = d.scale, vx = d.x;
+  let x = 0, src = vx;
+  while(x < 320){
+    const c = Math.floor(src / 320);
+    if(src < 0 || c >= d.cols){
+      row[x++] = DEVICE_WHITE;
+      src = Math.floor(x * scale + vx);
+      continue;
+    }
+    const lineEnd = (c + 1) * 320;
+    let pixel = c * 320, i = d.segOffsets[y * d.cols + c];
+    while(i < d.pixelBytes && x < 320 && src < lineEnd){
+      const b = data[i++];
+      const runEnd = pixel + (b >> 4) + 1, color = DEVICE_PALETTE[b & 0x0F];
+      while(src < runEnd && src < lineEnd && x < 320){
+        row[x++] = color;
+        src = Math.floor(x * scale + vx);
+      }
+      pixel = runEnd;
+    }
+    // stream ended before filling the segment: white, as on the calculator
+    while(src < lineEnd && x < 320){
+      row[x++] = DEVICE_WHITE;
+      src = Math.floor(x * scale + vx);
+    }
+  }
+}
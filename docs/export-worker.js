@@ -0,0 +1,95 @@
+// Quantise-and-RLE of a band of preview rows for "Export .bin". Runs in a
+// Web Worker, and is also loaded by the page so the export still works
+// where workers cannot start (pages opened from file://). The dithering of
+// the preview lives here too, so python/check_dither.py can run it.
+
+// Math.round() takes halves up, np.rint() to the even neighbour
+function roundHalfEven(v){
+  const r = Math.round(v);
+  return (r - v === 0.5 && r % 2 !== 0) ? r - 1 : r;
+}
+
+// Palette index of every grey of the preview, as the exporter has always
+// computed it: level of the grey, inverted if asked, spread over 0..15.
+function exportIndexLut(ncolors, invert){
+  const lut = new Uint8Array(256);
+  for(let g=0; g<256; g++){
+    let idx = Math.round(g/255*(ncolors-1));
+    if(invert) idx = (ncolors-1)-idx;
+    lut[g] = Math.round(idx/(ncolors-1)*15) & 0x0F;
+  }
+  return lut;
+}
+
+// Floyd-Steinberg error diffusion to levels grey levels, biased towards
+// runs, exactly as dither() in python/main.py: a pixel keeps the level on
+// its left unless another is closer by more than bias level steps, with
+// the same float64 operations in the same order. Returns a function that
+// writes the levels of row y of rgba (w pixels wide, RGBA) into row; rows
+// go top to bottom and the error is carried down the whole image. Pixels
+// from white on are white.
+function makeDither(w, levels, white, bias){
+  const top = levels - 1, step = 255/top, tolerance = bias*step;
+  let err = new Float64Array(w+2), next = new Float64Array(w+2);
+  return (rgba, y, row) => {
+    next.fill(0);
+    for(let x=0;x<w;x++){
+      const i = (y*w + x)*4;
+      let v = (rgba[i] + rgba[i+1] + rgba[i+2])/3;
+      if(v >= white) v = 255;
+      v += err[x+1];
+      let q = Math.min(top, Math.max(0, roundHalfEven(v/step)));
+      if(x > 0 && Math.abs(v - row[x-1]*step) <= Math.abs(v - q*step) + tolerance) q = row[x-1];
+      row[x] = q;
+      const e = v - q*step;
+      next[x] += e*(3/16);
+      err[x+2] += e*(7/16);
+      next[x+1] += e*(5/16);
+      next[x+2] += e*(1/16);
+    }
+    const t = err; err = next; next = t;
+  };
+}
+
+// Encodes rows of RGBA pixels (only the red channel is read: the preview
+// is grey) in 320-pixel segments of (run-1)<<4|index bytes. A segment
+// takes at most one byte per pixel, so the output is allocated once.
+// Returns the bytes written and the byte count of every row.
+function encodeBand(rgba, w, rows, ncolors, invert){
+  const lut = exportIndexLut(ncolors, invert);
+  const out = new Uint8Array(w * rows);
+  const rowBytes = new Uint32Array(rows);
+  let n = 0;
+  for(let y=0; y<rows; y++){
+    const start = n;
+    for(let xChunk=0; xChunk<w; xChunk+=320){
+      const xEnd = Math.min(xChunk+320, w);
+      let i = (y*w + xChunk)*4;
+      let cur = lut[rgba[i]];
+      let run = 1;
+      for(let x=xChunk+1; x<xEnd; x++){
+        i += 4;
+        const v = lut[rgba[i]];
+        if(v === cur && run < 16){ run++; }
+        else{
+          out[n++] = (run-1)<<4 | cur;
+          cur = v; run = 1;
+        }
+      }
+      out[n++] = (run-1)<<4 | cur;
+    }
+    rowBytes[y] = n - start;
+  }
+  return { data: out, length: n, rowBytes: rowBytes };
+}
+
+// In a worker: { band, rgba (ArrayBuffer), w, rows, ncolors, invert } in,
+// { band, data, length, rowBytes } out, buffers transferred both ways.
+if(typeof WorkerGlobalScope !== 'undefined' && self instanceof WorkerGlobalScope){
+  self.onmessage = e => {
+    const m = e.data;
+    const r = encodeBand(new Uint8Array(m.rgba), m.w, m.rows, m.ncolors, m.invert);
+    self.postMessage({ band: m.band, data: r.data.buffer, length: r.length, rowBytes: r.rowBytes.buffer },
+                     [r.data.buffer, r.rowBytes.buffer]);
+  };
+}
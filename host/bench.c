@@ -0,0 +1,180 @@
+/* Host benchmark of the viewer core. Runs startup, redraw, pan and zoom
+   scenarios over one cheatsheet file against the eadk stub and prints, per
+   scenario, the host time, bytes decoded and display calls per frame.
+
+   usage: bench [-m model] file.bin */
+#define _POSIX_C_SOURCE 199309L
+#include "eadk_stub.h"
+#include "viewer.h"
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+/* pan step of one frame, a multiple of the app's PAN_QUANTUM */
+#define PAN_STEP 16
+#define PAN_FRAMES 16
+#define REDRAW_FRAMES 8
+
+struct totals {
+    int frames;
+    double us;
+    unsigned long bytes_decoded;
+    unsigned long rows_decoded;
+    unsigned long pushes;
+    unsigned long pulls;
+};
+
+static struct totals current;
+static double max_scale = 1.0;
+
+static double now_us(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e6 + ts.tv_nsec / 1e3;
+}
+
+static void clamp_view(int *view_x, int *view_y, double scale) {
+    int max_x = viewer_width() - (int)ceil(320.0 * scale);
+    int max_y = viewer_height() - (int)ceil(240.0 * scale);
+    if (*view_x > max_x) *view_x = max_x;
+    if (*view_y > max_y) *view_y = max_y;
+    if (*view_x < 0) *view_x = 0;
+    if (*view_y < 0) *view_y = 0;
+}
+
+/* Draws one view to the end of its fine pass and adds it to current. A view
+   that is already on screen (after clamping) is not a frame. */
+static void frame(int view_x, int view_y, double scale, int jump) {
+    struct viewer_stats before, after;
+    struct stub_counters calls = stub_counters;
+    viewer_get_stats(&before);
+    double start = now_us();
+    if (jump) viewer_jump(view_x, view_y, scale);
+    else viewer_set_view(view_x, view_y, scale);
+    int drawn = viewer_render_step();
+    while (viewer_render_step()) {}
+    if (!drawn) return;
+    current.us += now_us() - start;
+    viewer_get_stats(&after);
+    current.frames++;
+    current.bytes_decoded += after.bytes_decoded - before.bytes_decoded;
+    current.rows_decoded += after.rows_decoded - before.rows_decoded;
+    current.pushes += stub_counters.push_calls - calls.push_calls;
+    current.pulls += stub_counters.pull_calls - calls.pull_calls;
+}
+
+/* what the app does between key presses */
+static void idle(void) {
+    while (viewer_prefetch_step()) {}
+}
+
+static void report(const char *name) {
+    int n = current.frames ? current.frames : 1;
+    printf("  %-12s %6d %10.0f %12lu %10lu %8.1f %8.1f\n", name, current.frames,
+           current.us / n, current.bytes_decoded / n, current.rows_decoded / n,
+           (double)current.pushes / n, (double)current.pulls / n);
+    memset(&current, 0, sizeof(current));
+}
+
+static double zoom_to(int *view_x, int *view_y, double scale, double new_scale) {
+    double center_x = *view_x + 160.0 * scale;
+    double center_y = *view_y + 120.0 * scale;
+    *view_x = (int)floor(center_x - 160.0 * new_scale);
+    *view_y = (int)floor(center_y - 120.0 * new_scale);
+    clamp_view(view_x, view_y, new_scale);
+    return new_scale;
+}
+
+int main(int argc, char **argv) {
+    const char *path = NULL;
+    for (int i = 1; i < argc; ++i) {
+        if (!strcmp(argv[i], "-m") && i + 1 < argc) stub_set_model((uint8_t)atoi(argv[++i]));
+        else path = argv[i];
+    }
+    if (!path) {
+        fprintf(stderr, "usage: %s [-m model] file.bin\n", argv[0]);
+        return 1;
+    }
+    if (!stub_load_external_data(path)) {
+        fprintf(stderr, "%s: cannot read\n", path);
+        return 1;
+    }
+
+    struct viewer_stats stats;
+    double start = now_us();
+    while (viewer_prepare_step()) {}
+    current.us = now_us() - start;
+    current.frames = 1;
+    viewer_get_stats(&stats);
+    current.bytes_decoded = stats.bytes_decoded;
+    current.rows_decoded = stats.rows_decoded;
+    if (viewer_status() != VIEWER_READY) {
+        printf("%s: %s\n", path, viewer_status() == VIEWER_EMPTY ? "empty" : "out of memory");
+        return viewer_status() == VIEWER_EMPTY ? 0 : 1;
+    }
+
+    int width = viewer_width(), height = viewer_height();
+    max_scale = fmin(width / 320.0, height / 240.0);
+    if (max_scale < 1.0) max_scale = 1.0;
+    printf("%s: %dx%d, band %d, index 1/%zu, row cache %zu, prefetch %d\n", path, width, height,
+           stats.band_height, stats.sample_interval, stats.row_cache_size, stats.prefetch_rows);
+    printf("  %-12s %6s %10s %12s %10s %8s %8s\n", "scenario", "frames", "us/frame",
+           "bytes/frame", "rows/frame", "pushes", "pulls");
+    report("startup");
+
+    frame(0, 0, VIEWER_FIRST_SCALE, 1);
+    report("first view");
+    idle();
+
+    /* jumps across the sheet, so every frame is decoded from scratch */
+    for (int i = 0; i < REDRAW_FRAMES; ++i) {
+        int view_x = (int)((long)width * i / REDRAW_FRAMES), view_y = (int)((long)height * i / REDRAW_FRAMES);
+        clamp_view(&view_x, &view_y, 1.0);
+        frame(view_x, view_y, 1.0, 1);
+    }
+    report("redraw 1:1");
+    for (int i = 0; i < REDRAW_FRAMES; ++i) {
+        int view_x = (int)((long)width * (REDRAW_FRAMES - 1 - i) / REDRAW_FRAMES), view_y = (int)((long)height * i / REDRAW_FRAMES);
+        clamp_view(&view_x, &view_y, fmin(2.0, max_scale));
+        frame(view_x, view_y, fmin(2.0, max_scale), 1);
+    }
+    report("redraw 2:1");
+
+    int view_x = width / 2 - 160, view_y = height / 2 - 120;
+    double scale = 1.0;
+    clamp_view(&view_x, &view_y, scale);
+    frame(view_x, view_y, scale, 1);
+    idle();
+    memset(&current, 0, sizeof(current));
+    for (int i = 0; i < PAN_FRAMES; ++i) {
+        view_y += PAN_STEP;
+        clamp_view(&view_x, &view_y, scale);
+        frame(view_x, view_y, scale, 0);
+        idle();
+    }
+    report("pan down");
+    for (int i = 0; i < PAN_FRAMES; ++i) {
+        view_x += PAN_STEP;
+        clamp_view(&view_x, &view_y, scale);
+        frame(view_x, view_y, scale, 0);
+        idle();
+    }
+    report("pan right");
+
+    while (scale < max_scale) {
+        scale = zoom_to(&view_x, &view_y, scale, fmin(scale + 0.25, max_scale));
+        frame(view_x, view_y, scale, 0);
+    }
+    report("zoom out");
+    idle();
+    while (scale > 1.0) {
+        scale = zoom_to(&view_x, &view_y, scale, fmax(scale - 0.25, 1.0));
+        frame(view_x, view_y, scale, 0);
+    }
+    report("zoom in");
+
+    viewer_free();
+    return 0;
+}
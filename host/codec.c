@@ -0,0 +1,370 @@
+/* Host benchmark of cheatsheet encodings. Each image of the corpus is
+   encoded with every variant below and the tool prints the encoded size,
+   full decode throughput, the longest line and the cost of decoding one
+   pixel at a random x of a line whose start is known, which is what the
+   viewer does when it resolves a band from its row offsets.
+
+   The corpus is the pixel content of the given cheatsheet files, which the
+   encoder has already reduced to palette indices so it is recovered
+   exactly, followed by synthetic worst cases: a blank sheet, an ordered
+   dither and a noisy photo-like gradient.
+
+     rle4       the current format, (run - 1) << 4 | index, decoded by
+                src/rle.c as on the calculator
+     packed4    two pixels per byte, 160 bytes per line
+     rle4x      rle4 where a run nibble of 15 is followed by a byte of
+                extra pixels, so a run can cover the whole line
+     adaptive   per line, a tag byte then rle4 or packed4, whichever is
+                smaller
+
+   usage: codec [-t seconds] [file.bin ...] */
+#define _POSIX_C_SOURCE 199309L
+#include "rle.h"
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define LINE 320
+#define SYNTH_WIDTH 960
+#define SYNTH_HEIGHT 720
+#define SEEKS 200000
+#define FOOTER_SIZE 8
+#define HOTSPOT_RECORD_SIZE (16 + 12 + 240 * 4)
+
+static const uint16_t palette[16] = {
+    0x0000, 0x1082, 0x2104, 0x3186,
+    0x4228, 0x52AA, 0x632C, 0x73AE,
+    0x8C51, 0x9CD3, 0xAD55, 0xBDD7,
+    0xCE79, 0xDE7B, 0xEF7D, 0xFFFF
+};
+
+/* an image as 320-pixel lines of palette indices, in file order */
+struct image {
+    char name[64];
+    uint8_t *pixels;
+    size_t lines;
+};
+
+/* an encoded image with the offset of every line */
+struct encoded {
+    uint8_t *data;
+    size_t size;
+    size_t *line_offsets;
+};
+
+struct codec {
+    const char *name;
+    /* appends one line to out and returns its size */
+    size_t (*encode)(const uint8_t *line, uint8_t *out);
+    /* decodes pixels [x, x + w) of the line at off, returns bytes read */
+    size_t (*decode)(const uint8_t *data, size_t size, size_t off, int x, int w, eadk_color_t *out);
+};
+
+static double seconds = 0.5;
+
+static double now_us(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e6 + ts.tv_nsec / 1e3;
+}
+
+static uint32_t random_state = 1;
+
+static uint32_t random_next(void) {
+    random_state = random_state * 1103515245u + 12345u;
+    return random_state >> 8;
+}
+
+static size_t rle4_encode(const uint8_t *line, uint8_t *out) {
+    size_t n = 0;
+    for (int x = 0; x < LINE;) {
+        int run = 1;
+        while (x + run < LINE && run < 16 && line[x + run] == line[x]) run++;
+        out[n++] = (uint8_t)((run - 1) << 4 | line[x]);
+        x += run;
+    }
+    return n;
+}
+
+static size_t rle4_decode(const uint8_t *data, size_t size, size_t off, int x, int w, eadk_color_t *out) {
+    return rle_decode_span(data, size, off, x, w, palette, out) - off;
+}
+
+static size_t packed4_encode(const uint8_t *line, uint8_t *out) {
+    for (int x = 0; x < LINE; x += 2) out[x >> 1] = (uint8_t)(line[x] << 4 | line[x + 1]);
+    return LINE / 2;
+}
+
+static size_t packed4_decode(const uint8_t *data, size_t size, size_t off, int x, int w, eadk_color_t *out) {
+    size_t first = off + (size_t)(x >> 1), last = off + (size_t)((x + w - 1) >> 1);
+    if (last >= size) return 0;
+    for (int i = x; i < x + w; ++i) {
+        uint8_t b = data[off + (size_t)(i >> 1)];
+        out[i - x] = palette[(i & 1) ? b & 0x0F : b >> 4];
+    }
+    return last + 1 - first;
+}
+
+static size_t rle4x_encode(const uint8_t *line, uint8_t *out) {
+    size_t n = 0;
+    for (int x = 0; x < LINE;) {
+        int run = 1;
+        while (x + run < LINE && run < 16 + 255 && line[x + run] == line[x]) run++;
+        if (run >= 16) {
+            out[n++] = (uint8_t)(15 << 4 | line[x]);
+            out[n++] = (uint8_t)(run - 16);
+        } else {
+            out[n++] = (uint8_t)((run - 1) << 4 | line[x]);
+        }
+        x += run;
+    }
+    return n;
+}
+
+static size_t rle4x_decode(const uint8_t *data, size_t size, size_t off, int x, int w, eadk_color_t *out) {
+    size_t start = off;
+    int end = x + w;
+    int pixel = 0;
+    while (off < size && pixel < end) {
+        uint8_t b = data[off++];
+        int run = (b >> 4) + 1;
+        if (run == 16 && off < size) run += data[off++];
+        int run_end = pixel + run;
+        if (run_end > x) {
+            eadk_color_t color = palette[b & 0x0F];
+            int from = pixel > x ? pixel : x;
+            int to = run_end < end ? run_end : end;
+            for (int i = from; i < to; ++i) out[i - x] = color;
+        }
+        pixel = run_end;
+    }
+    return off - start;
+}
+
+static size_t adaptive_encode(const uint8_t *line, uint8_t *out) {
+    size_t n = rle4_encode(line, out + 1);
+    if (n <= LINE / 2) {
+        out[0] = 0;
+        return n + 1;
+    }
+    out[0] = 1;
+    return packed4_encode(line, out + 1) + 1;
+}
+
+static size_t adaptive_decode(const uint8_t *data, size_t size, size_t off, int x, int w, eadk_color_t *out) {
+    if (off >= size) return 0;
+    if (data[off]) return packed4_decode(data, size, off + 1, x, w, out) + 1;
+    return rle4_decode(data, size, off + 1, x, w, out) + 1;
+}
+
+static const struct codec codecs[] = {
+    { "rle4", rle4_encode, rle4_decode },
+    { "packed4", packed4_encode, packed4_decode },
+    { "rle4x", rle4x_encode, rle4x_decode },
+    { "adaptive", adaptive_encode, adaptive_decode },
+};
+#define CODEC_COUNT (sizeof(codecs) / sizeof(codecs[0]))
+
+static int image_alloc(struct image *img, const char *name, size_t lines) {
+    snprintf(img->name, sizeof(img->name), "%s", name);
+    img->lines = lines;
+    img->pixels = (uint8_t*)malloc(lines * LINE);
+    return img->pixels != NULL;
+}
+
+/* The lines of a cheatsheet file, without its trailer. */
+static int image_load(struct image *img, const char *path) {
+    FILE *f = fopen(path, "rb");
+    if (!f) return 0;
+    fseek(f, 0, SEEK_END);
+    long size = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    uint8_t *data = (uint8_t*)malloc(size > 0 ? (size_t)size : 1);
+    if (!data || size < 0 || fread(data, 1, (size_t)size, f) != (size_t)size) {
+        free(data);
+        fclose(f);
+        return 0;
+    }
+    fclose(f);
+    size_t data_size = (size_t)size;
+    if (data_size >= FOOTER_SIZE && !memcmp(data + data_size - 4, "CSHS", 4)) {
+        size_t count = data[data_size - FOOTER_SIZE] | data[data_size - FOOTER_SIZE + 1] << 8;
+        size_t trailer = count * HOTSPOT_RECORD_SIZE + FOOTER_SIZE;
+        if (trailer <= data_size) data_size -= trailer;
+    }
+
+    size_t lines = 0;
+    int pixel = 0;
+    for (size_t off = 0; off < data_size; ++off) {
+        pixel += (data[off] >> 4) + 1;
+        if (pixel >= LINE) {
+            lines++;
+            pixel = 0;
+        }
+    }
+    const char *base = strrchr(path, '/');
+    if (!image_alloc(img, base ? base + 1 : path, lines)) {
+        free(data);
+        return 0;
+    }
+    eadk_color_t colors[LINE];
+    size_t off = 0;
+    for (size_t l = 0; l < lines; ++l) {
+        off = rle_decode_span(data, data_size, off, 0, LINE, palette, colors);
+        for (int x = 0; x < LINE; ++x) {
+            int idx = 0;
+            while (idx < 15 && palette[idx] != colors[x]) idx++;
+            img->pixels[l * LINE + (size_t)x] = (uint8_t)idx;
+        }
+    }
+    free(data);
+    return 1;
+}
+
+/* Synthetic sheets, SYNTH_WIDTH x SYNTH_HEIGHT, in the encoder's line
+   order (each row split into 320-pixel lines). */
+enum { SYNTH_BLANK, SYNTH_DITHER, SYNTH_PHOTO, SYNTH_COUNT };
+static const char *const synth_names[SYNTH_COUNT] = { "blank", "dither", "photo" };
+
+static int image_synth(struct image *img, int kind) {
+    static const uint8_t bayer[4][4] = {
+        { 0, 8, 2, 10 }, { 12, 4, 14, 6 }, { 3, 11, 1, 9 }, { 15, 7, 13, 5 }
+    };
+    size_t cols = SYNTH_WIDTH / LINE;
+    if (!image_alloc(img, synth_names[kind], (size_t)SYNTH_HEIGHT * cols)) return 0;
+    random_state = 1;
+    for (int y = 0; y < SYNTH_HEIGHT; ++y) {
+        for (int x = 0; x < SYNTH_WIDTH; ++x) {
+            int idx = 15;
+            if (kind == SYNTH_DITHER) {
+                /* two-level ordered dither of a horizontal gradient */
+                idx = x * 16 / SYNTH_WIDTH > bayer[y & 3][x & 3] ? 15 : 0;
+            } else if (kind == SYNTH_PHOTO) {
+                double v = 7.5 + 5.0 * sin(x / 37.0) * cos(y / 53.0) + 2.0 * sin((x + y) / 11.0);
+                v += (random_next() % 1000) / 1000.0 * 3.0 - 1.5;
+                idx = v < 0.0 ? 0 : v > 15.0 ? 15 : (int)lround(v);
+            }
+            size_t line = (size_t)y * cols + (size_t)(x / LINE);
+            img->pixels[line * LINE + (size_t)(x % LINE)] = (uint8_t)idx;
+        }
+    }
+    return 1;
+}
+
+static int encode(const struct codec *codec, const struct image *img, struct encoded *enc) {
+    /* no variant takes more than two bytes per pixel */
+    enc->data = (uint8_t*)malloc(img->lines * LINE * 2 + 1);
+    enc->line_offsets = (size_t*)malloc((img->lines + 1) * sizeof(size_t));
+    if (!enc->data || !enc->line_offsets) return 0;
+    enc->size = 0;
+    for (size_t l = 0; l < img->lines; ++l) {
+        enc->line_offsets[l] = enc->size;
+        enc->size += codec->encode(img->pixels + l * LINE, enc->data + enc->size);
+    }
+    enc->line_offsets[img->lines] = enc->size;
+    return 1;
+}
+
+/* Decodes every line and compares it with the source. */
+static int verify(const struct codec *codec, const struct image *img, const struct encoded *enc) {
+    eadk_color_t colors[LINE];
+    for (size_t l = 0; l < img->lines; ++l) {
+        size_t read = codec->decode(enc->data, enc->size, enc->line_offsets[l], 0, LINE, colors);
+        if (read != enc->line_offsets[l + 1] - enc->line_offsets[l]) return 0;
+        for (int x = 0; x < LINE; ++x) {
+            if (colors[x] != palette[img->pixels[l * LINE + (size_t)x]]) return 0;
+        }
+    }
+    return 1;
+}
+
+static void report(const struct codec *codec, const struct image *img) {
+    struct encoded enc;
+    if (!encode(codec, img, &enc)) {
+        printf("  %-9s out of memory\n", codec->name);
+        exit(1);
+    }
+    if (!verify(codec, img, &enc)) {
+        printf("  %-9s does not decode back to the source\n", codec->name);
+        exit(1);
+    }
+
+    size_t worst = 0;
+    for (size_t l = 0; l < img->lines; ++l) {
+        size_t n = enc.line_offsets[l + 1] - enc.line_offsets[l];
+        if (n > worst) worst = n;
+    }
+
+    /* whole passes over the image for at least the given time */
+    eadk_color_t colors[LINE];
+    volatile eadk_color_t sink = 0;
+    unsigned long passes = 0;
+    double start = now_us(), elapsed;
+    do {
+        for (size_t l = 0; l < img->lines; ++l) {
+            codec->decode(enc.data, enc.size, enc.line_offsets[l], 0, LINE, colors);
+            sink ^= colors[l % LINE];
+        }
+        passes++;
+        elapsed = now_us() - start;
+    } while (elapsed < seconds * 1e6);
+    double mb_s = (double)enc.size * passes / elapsed;
+    double mpx_s = (double)img->lines * LINE * passes / elapsed;
+
+    random_state = 7;
+    size_t *seek_line = (size_t*)malloc(SEEKS * sizeof(size_t));
+    int *seek_x = (int*)malloc(SEEKS * sizeof(int));
+    if (!seek_line || !seek_x) exit(1);
+    for (int i = 0; i < SEEKS; ++i) {
+        seek_line[i] = random_next() % img->lines;
+        seek_x[i] = (int)(random_next() % LINE);
+    }
+    unsigned long long seek_bytes = 0;
+    start = now_us();
+    for (int i = 0; i < SEEKS; ++i) {
+        seek_bytes += codec->decode(enc.data, enc.size, enc.line_offsets[seek_line[i]], seek_x[i], 1, colors);
+        sink ^= colors[0];
+    }
+    elapsed = now_us() - start;
+    (void)sink;
+
+    printf("  %-9s %10zu %7.2f %9.1f %9.1f %7zu %10.1f %8.1f\n", codec->name, enc.size,
+           enc.size * 8.0 / ((double)img->lines * LINE), mb_s, mpx_s, worst,
+           (double)seek_bytes / SEEKS, elapsed * 1e3 / SEEKS);
+    free(seek_line);
+    free(seek_x);
+    free(enc.data);
+    free(enc.line_offsets);
+}
+
+static void run(const struct image *img) {
+    printf("%s: %zu lines of %d pixels\n", img->name, img->lines, LINE);
+    printf("  %-9s %10s %7s %9s %9s %7s %10s %8s\n", "encoding", "bytes", "bits/px",
+           "MB/s", "Mpx/s", "worst", "seek bytes", "seek ns");
+    for (size_t c = 0; c < CODEC_COUNT; ++c) report(&codecs[c], img);
+}
+
+int main(int argc, char **argv) {
+    for (int i = 1; i < argc; ++i) {
+        struct image img;
+        if (!strcmp(argv[i], "-t") && i + 1 < argc) {
+            seconds = atof(argv[++i]);
+            continue;
+        }
+        if (!image_load(&img, argv[i])) {
+            fprintf(stderr, "%s: cannot read\n", argv[i]);
+            return 1;
+        }
+        run(&img);
+        free(img.pixels);
+    }
+    for (int kind = 0; kind < SYNTH_COUNT; ++kind) {
+        struct image img;
+        if (!image_synth(&img, kind)) return 1;
+        run(&img);
+        free(img.pixels);
+    }
+    return 0;
+}
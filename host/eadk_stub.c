@@ -0,0 +1,140 @@
+#include "eadk_stub.h"
+#include "libs/storage.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+struct stub_counters stub_counters;
+eadk_color_t stub_framebuffer[EADK_SCREEN_WIDTH * EADK_SCREEN_HEIGHT];
+
+const char *eadk_external_data = NULL;
+size_t eadk_external_data_size = 0;
+
+eadk_keyboard_state_t (*stub_scan_hook)(void) = NULL;
+eadk_event_t (*stub_event_hook)(int32_t *timeout) = NULL;
+
+static uint64_t clock_ms = 0;
+static uint8_t calculator_model = 1;
+
+int stub_load_external_data(const char *path) {
+    FILE *f = fopen(path, "rb");
+    if (!f) return 0;
+    fseek(f, 0, SEEK_END);
+    long size = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    char *data = (char*)malloc(size > 0 ? (size_t)size : 1);
+    if (!data || size < 0 || fread(data, 1, (size_t)size, f) != (size_t)size) {
+        free(data);
+        fclose(f);
+        return 0;
+    }
+    fclose(f);
+    eadk_external_data = data;
+    eadk_external_data_size = (size_t)size;
+    return 1;
+}
+
+void stub_set_model(uint8_t model) {
+    calculator_model = model;
+}
+
+void stub_clock_advance(uint32_t ms) {
+    clock_ms += ms;
+}
+
+uint32_t stub_framebuffer_checksum(void) {
+    uint32_t hash = 2166136261u;
+    for (size_t i = 0; i < sizeof(stub_framebuffer) / sizeof(stub_framebuffer[0]); ++i) {
+        hash = (hash ^ (stub_framebuffer[i] & 0xFF)) * 16777619u;
+        hash = (hash ^ (stub_framebuffer[i] >> 8)) * 16777619u;
+    }
+    return hash;
+}
+
+/* the part of rect that is on screen, as x0, y0, x1, y1 */
+static int clip(eadk_rect_t rect, int *x0, int *y0, int *x1, int *y1) {
+    *x0 = rect.x;
+    *y0 = rect.y;
+    *x1 = rect.x + rect.width;
+    *y1 = rect.y + rect.height;
+    if (*x1 > EADK_SCREEN_WIDTH) *x1 = EADK_SCREEN_WIDTH;
+    if (*y1 > EADK_SCREEN_HEIGHT) *y1 = EADK_SCREEN_HEIGHT;
+    return *x0 < *x1 && *y0 < *y1;
+}
+
+void eadk_display_push_rect(eadk_rect_t rect, const eadk_color_t *pixels) {
+    int x0, y0, x1, y1;
+    stub_counters.push_calls++;
+    stub_counters.push_pixels += (unsigned long)rect.width * rect.height;
+    if (!clip(rect, &x0, &y0, &x1, &y1)) return;
+    for (int y = y0; y < y1; ++y) {
+        for (int x = x0; x < x1; ++x) {
+            stub_framebuffer[y * EADK_SCREEN_WIDTH + x] = pixels[(y - rect.y) * rect.width + (x - rect.x)];
+        }
+    }
+}
+
+void eadk_display_push_rect_uniform(eadk_rect_t rect, eadk_color_t color) {
+    int x0, y0, x1, y1;
+    stub_counters.uniform_calls++;
+    if (!clip(rect, &x0, &y0, &x1, &y1)) return;
+    for (int y = y0; y < y1; ++y) {
+        for (int x = x0; x < x1; ++x) stub_framebuffer[y * EADK_SCREEN_WIDTH + x] = color;
+    }
+}
+
+void eadk_display_pull_rect(eadk_rect_t rect, eadk_color_t *pixels) {
+    stub_counters.pull_calls++;
+    stub_counters.pull_pixels += (unsigned long)rect.width * rect.height;
+    for (int y = 0; y < rect.height; ++y) {
+        for (int x = 0; x < rect.width; ++x) {
+            int sx = rect.x + x, sy = rect.y + y;
+            pixels[y * rect.width + x] = (sx < EADK_SCREEN_WIDTH && sy < EADK_SCREEN_HEIGHT)
+                ? stub_framebuffer[sy * EADK_SCREEN_WIDTH + sx] : 0;
+        }
+    }
+}
+
+bool eadk_display_wait_for_vblank() {
+    stub_counters.vblank_waits++;
+    return true;
+}
+
+void eadk_display_draw_string(const char *text, eadk_point_t point, bool large_font,
+                              eadk_color_t text_color, eadk_color_t background_color) {
+}
+
+eadk_keyboard_state_t eadk_keyboard_scan() {
+    return stub_scan_hook ? stub_scan_hook() : 0;
+}
+
+/* without a hook every wait times out with a non-key event */
+eadk_event_t eadk_event_get(int32_t *timeout) {
+    if (stub_event_hook) return stub_event_hook(timeout);
+    if (timeout) clock_ms += (uint64_t)*timeout;
+    return (eadk_event_t)0xFFFF;
+}
+
+void eadk_timing_usleep(uint32_t us) {
+    clock_ms += us / 1000;
+}
+
+void eadk_timing_msleep(uint32_t ms) {
+    clock_ms += ms;
+}
+
+uint64_t eadk_timing_millis() {
+    return clock_ms;
+}
+
+const uint8_t extapp_calculatorModel() {
+    return calculator_model;
+}
+
+/* records land in files of the same name in the working directory */
+bool extapp_fileWrite(const char *filename, const char *content, size_t len) {
+    FILE *f = fopen(filename, "wb");
+    if (!f) return false;
+    size_t written = fwrite(content, 1, len, f);
+    fclose(f);
+    return written == len;
+}
@@ -0,0 +1,36 @@
+#ifndef EADK_STUB_H
+#define EADK_STUB_H
+
+#include "libs/eadk.h"
+
+/* Host stand-in for the eadk and storage calls the viewer core makes: the
+   display is an in-memory framebuffer, display calls are counted and the
+   clock only moves when the app sleeps or stub_clock_advance() is called,
+   so runs are repeatable. */
+
+struct stub_counters {
+    unsigned long push_calls;
+    unsigned long push_pixels;
+    unsigned long uniform_calls;
+    unsigned long pull_calls;
+    unsigned long pull_pixels;
+    unsigned long vblank_waits;
+};
+
+extern struct stub_counters stub_counters;
+extern eadk_color_t stub_framebuffer[EADK_SCREEN_WIDTH * EADK_SCREEN_HEIGHT];
+
+/* When set, keyboard input comes from these instead of a keyboard on
+   which no key is ever pressed. */
+extern eadk_keyboard_state_t (*stub_scan_hook)(void);
+extern eadk_event_t (*stub_event_hook)(int32_t *timeout);
+
+/* Loads a cheatsheet file as the external data. Returns 0 on failure. */
+int stub_load_external_data(const char *path);
+/* what extapp_calculatorModel() reports: 1 is N0110/N0115, 2 is N0120 */
+void stub_set_model(uint8_t model);
+void stub_clock_advance(uint32_t ms);
+/* FNV-1a of the framebuffer, to tell whether two runs drew the same */
+uint32_t stub_framebuffer_checksum(void);
+
+#endif
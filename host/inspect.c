@@ -0,0 +1,341 @@
+/* Inspects a cheatsheet file the way the calculator reads it. The viewer
+   core indexes it as on startup, so the layout reported is the one the app
+   would pick, then the line walk is repeated here to report what each line
+   costs and where the stream does not split into whole 320-pixel lines:
+   a run crossing the end of a line (its excess pixels are dropped and the
+   lines after it shift) or a last line cut short (indexing stops there).
+
+   With -o the sheet is also drawn to a PNG by the viewer itself, one screen
+   at a time, so the image shows exactly what the calculator draws at that
+   zoom (source pixels per screen pixel, a multiple of 1/80 so that screens
+   tile). With -v only the screen at view (x, y) is drawn, as a 320x240
+   PNG. With -l every line is listed as CSV.
+
+   Exits with 2 when the stream has stalled lines.
+
+   usage: inspect [-m model] [-l] [-z zoom] [-v x,y] [-o out.png] file.bin */
+#include "eadk_stub.h"
+#include "viewer.h"
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define LINE 320
+#define FOOTER_SIZE 8
+#define HOTSPOT_RECORD_SIZE (16 + 12 + 240 * 4)
+#define STALLED_SHOWN 10
+#define COSTLIEST_SHOWN 5
+
+static const uint16_t palette[16] = {
+    0x0000, 0x1082, 0x2104, 0x3186,
+    0x4228, 0x52AA, 0x632C, 0x73AE,
+    0x8C51, 0x9CD3, 0xAD55, 0xBDD7,
+    0xCE79, 0xDE7B, 0xEF7D, 0xFFFF
+};
+
+static const char *const cols_sources[] = {
+    "from the trailer", "square sheet", "guessed from the content", "default"
+};
+
+/* one line of the walk: its offset, size and the pixels its runs cover */
+struct line {
+    size_t offset;
+    uint16_t bytes;
+    uint16_t pixels;
+};
+
+static struct line *lines = NULL;
+static size_t line_count = 0;
+/* bytes after the last whole line, and the pixels they cover */
+static size_t tail_bytes = 0;
+static size_t tail_pixels = 0;
+
+static uint32_t read_le(const uint8_t *p, int bytes) {
+    uint32_t v = 0;
+    for (int i = bytes - 1; i >= 0; --i) v = (v << 8) | p[i];
+    return v;
+}
+
+/* Splits data into lines as line_bytes() in the viewer does: a line ends
+   with the run that reaches 320 pixels. */
+static int walk_lines(const uint8_t *data, size_t size) {
+    size_t cap = size / 20 + 16;
+    lines = (struct line*)malloc(cap * sizeof(struct line));
+    if (!lines) return 0;
+    size_t off = 0;
+    while (off < size) {
+        size_t start = off;
+        unsigned pixels = 0;
+        while (pixels < LINE && off < size) pixels += (data[off++] >> 4) + 1;
+        if (pixels < LINE) {
+            tail_bytes = off - start;
+            tail_pixels = pixels;
+            break;
+        }
+        if (line_count == cap) {
+            cap *= 2;
+            struct line *grown = (struct line*)realloc(lines, cap * sizeof(struct line));
+            if (!grown) return 0;
+            lines = grown;
+        }
+        lines[line_count].offset = start;
+        lines[line_count].bytes = (uint16_t)(off - start);
+        lines[line_count].pixels = (uint16_t)pixels;
+        line_count++;
+    }
+    return 1;
+}
+
+static uint32_t crc_table[256];
+
+static uint32_t crc32_update(uint32_t crc, const uint8_t *p, size_t n) {
+    if (!crc_table[1]) {
+        for (uint32_t i = 0; i < 256; ++i) {
+            uint32_t c = i;
+            for (int k = 0; k < 8; ++k) c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+            crc_table[i] = c;
+        }
+    }
+    crc = ~crc;
+    for (size_t i = 0; i < n; ++i) crc = crc_table[(crc ^ p[i]) & 0xFF] ^ (crc >> 8);
+    return ~crc;
+}
+
+static void put_be32(uint8_t *p, uint32_t v) {
+    p[0] = (uint8_t)(v >> 24);
+    p[1] = (uint8_t)(v >> 16);
+    p[2] = (uint8_t)(v >> 8);
+    p[3] = (uint8_t)v;
+}
+
+static int write_chunk(FILE *f, const char *type, const uint8_t *data, size_t size) {
+    uint8_t head[8], tail[4];
+    put_be32(head, (uint32_t)size);
+    memcpy(head + 4, type, 4);
+    uint32_t crc = crc32_update(crc32_update(0, head + 4, 4), data, size);
+    put_be32(tail, crc);
+    return fwrite(head, 1, 8, f) == 8 && fwrite(data, 1, size, f) == size && fwrite(tail, 1, 4, f) == 4;
+}
+
+/* Writes 4-bit palette scanlines as a PNG, in stored (uncompressed) deflate
+   blocks so no zlib is needed. */
+static int write_png(const char *path, const uint8_t *raw, size_t raw_size, int width, int height) {
+    FILE *f = fopen(path, "wb");
+    if (!f) return 0;
+    static const uint8_t signature[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n' };
+    uint8_t ihdr[13] = { 0 };
+    put_be32(ihdr, (uint32_t)width);
+    put_be32(ihdr + 4, (uint32_t)height);
+    ihdr[8] = 4;
+    ihdr[9] = 3;
+    uint8_t plte[16 * 3];
+    for (int i = 0; i < 16; ++i) {
+        plte[i * 3] = (uint8_t)((palette[i] >> 11) * 255 / 31);
+        plte[i * 3 + 1] = (uint8_t)(((palette[i] >> 5) & 0x3F) * 255 / 63);
+        plte[i * 3 + 2] = (uint8_t)((palette[i] & 0x1F) * 255 / 31);
+    }
+
+    size_t blocks = raw_size / 65535 + 1;
+    size_t zsize = 2 + blocks * 5 + raw_size + 4;
+    uint8_t *z = (uint8_t*)malloc(zsize);
+    if (!z) {
+        fclose(f);
+        return 0;
+    }
+    size_t n = 0;
+    z[n++] = 0x78;
+    z[n++] = 0x01;
+    uint32_t a = 1, b = 0;
+    for (size_t done = 0, k = 0; k < blocks; ++k) {
+        size_t len = raw_size - done < 65535 ? raw_size - done : 65535;
+        z[n++] = k + 1 == blocks;
+        z[n++] = (uint8_t)len;
+        z[n++] = (uint8_t)(len >> 8);
+        z[n++] = (uint8_t)~len;
+        z[n++] = (uint8_t)(~len >> 8);
+        memcpy(z + n, raw + done, len);
+        for (size_t i = 0; i < len; ++i) {
+            a = (a + raw[done + i]) % 65521;
+            b = (b + a) % 65521;
+        }
+        n += len;
+        done += len;
+    }
+    put_be32(z + n, b << 16 | a);
+    n += 4;
+
+    int ok = fwrite(signature, 1, 8, f) == 8 && write_chunk(f, "IHDR", ihdr, sizeof(ihdr)) &&
+             write_chunk(f, "PLTE", plte, sizeof(plte)) && write_chunk(f, "IDAT", z, n) &&
+             write_chunk(f, "IEND", NULL, 0);
+    free(z);
+    return fclose(f) == 0 && ok;
+}
+
+static int palette_index(eadk_color_t color) {
+    int idx = 0;
+    while (idx < 15 && palette[idx] != color) idx++;
+    return idx;
+}
+
+/* Draws the sheet one screen at a time with viewer_jump() and copies each
+   screen out of the stub framebuffer; with view, only the screen there. */
+static int render_png(const char *path, double zoom, const int *view) {
+    int width = (int)ceil(viewer_width() / zoom), height = (int)ceil(viewer_height() / zoom);
+    if (view) {
+        width = 320;
+        height = 240;
+    }
+    size_t stride = (size_t)(width + 1) / 2 + 1;
+    uint8_t *raw = (uint8_t*)calloc((size_t)height, stride);
+    if (!raw) return 0;
+    for (int ty = 0; ty * 240 < height; ++ty) {
+        for (int tx = 0; tx * 320 < width; ++tx) {
+            if (view) viewer_jump(view[0], view[1], zoom);
+            else viewer_jump((int)lround(tx * 320 * zoom), (int)lround(ty * 240 * zoom), zoom);
+            while (viewer_render_step()) {}
+            for (int sy = 0; sy < 240 && ty * 240 + sy < height; ++sy) {
+                uint8_t *row = raw + (size_t)(ty * 240 + sy) * stride + 1;
+                for (int sx = 0; sx < 320 && tx * 320 + sx < width; ++sx) {
+                    int x = tx * 320 + sx;
+                    int idx = palette_index(stub_framebuffer[sy * EADK_SCREEN_WIDTH + sx]);
+                    row[x >> 1] |= (uint8_t)((x & 1) ? idx : idx << 4);
+                }
+            }
+        }
+    }
+    int ok = write_png(path, raw, (size_t)height * stride, width, height);
+    free(raw);
+    if (ok && view) printf("wrote %s: view %d,%d at zoom %g\n", path, view[0], view[1], zoom);
+    else if (ok) printf("wrote %s: %dx%d at zoom %g\n", path, width, height, zoom);
+    return ok;
+}
+
+int main(int argc, char **argv) {
+    const char *path = NULL, *png = NULL;
+    double zoom = 1.0;
+    int list = 0, view[2], has_view = 0;
+    for (int i = 1; i < argc; ++i) {
+        if (!strcmp(argv[i], "-m") && i + 1 < argc) stub_set_model((uint8_t)atoi(argv[++i]));
+        else if (!strcmp(argv[i], "-z") && i + 1 < argc) zoom = atof(argv[++i]);
+        else if (!strcmp(argv[i], "-o") && i + 1 < argc) png = argv[++i];
+        else if (!strcmp(argv[i], "-v") && i + 1 < argc) has_view = sscanf(argv[++i], "%d,%d", &view[0], &view[1]) == 2;
+        else if (!strcmp(argv[i], "-l")) list = 1;
+        else path = argv[i];
+    }
+    if (!path) {
+        fprintf(stderr, "usage: %s [-m model] [-l] [-z zoom] [-v x,y] [-o out.png] file.bin\n", argv[0]);
+        return 1;
+    }
+    if (zoom <= 0.0 || fabs(zoom * 80.0 - floor(zoom * 80.0 + 0.5)) > 1e-9) {
+        fprintf(stderr, "%s: zoom must be a positive multiple of 1/80\n", argv[0]);
+        return 1;
+    }
+    if (!stub_load_external_data(path)) {
+        fprintf(stderr, "%s: cannot read\n", path);
+        return 1;
+    }
+
+    const uint8_t *data = (const uint8_t*)eadk_external_data;
+    size_t size = eadk_external_data_size;
+    printf("%s: %zu bytes", path, size);
+    if (size >= FOOTER_SIZE && !memcmp(data + size - 4, "CSHS", 4)) {
+        size_t count = read_le(data + size - FOOTER_SIZE, 2);
+        size_t trailer = count * HOTSPOT_RECORD_SIZE + FOOTER_SIZE;
+        printf(", trailer with %zu hotspots and %u cols", count, (unsigned)read_le(data + size - 6, 2));
+        if (trailer <= size) size -= trailer;
+        else printf(" (larger than the file)");
+    } else {
+        printf(", no trailer");
+    }
+    printf("\n");
+
+    if (!walk_lines(data, size)) {
+        fprintf(stderr, "%s: out of memory\n", path);
+        return 1;
+    }
+    unsigned long long total_pixels = 0;
+    for (size_t off = 0; off < size; ++off) total_pixels += (data[off] >> 4) + 1;
+
+    while (viewer_prepare_step()) {}
+    if (viewer_status() != VIEWER_READY) {
+        printf("%s: %s\n", path, viewer_status() == VIEWER_EMPTY ? "empty" : "out of memory");
+        return viewer_status() == VIEWER_EMPTY ? 0 : 1;
+    }
+    struct viewer_stats stats;
+    viewer_get_stats(&stats);
+    size_t rows = stats.line_count / stats.cols;
+    printf("lines: %zu whole, %llu by pixel count, %zu used\n", line_count, total_pixels / LINE,
+           stats.line_count);
+    printf("layout: %zu cols (%s), %zu rows, %dx%d", stats.cols, cols_sources[stats.cols_source],
+           rows, viewer_width(), viewer_height());
+    if (rows % 240 || stats.line_count % stats.cols) printf(", not whole 320x240 tiles");
+    printf("\n");
+
+    size_t min = SIZE_MAX, max = 0, over_packed = 0;
+    unsigned long long sum = 0;
+    for (size_t l = 0; l < line_count; ++l) {
+        if (lines[l].bytes < min) min = lines[l].bytes;
+        if (lines[l].bytes > max) max = lines[l].bytes;
+        if (lines[l].bytes > LINE / 2) over_packed++;
+        sum += lines[l].bytes;
+    }
+    if (line_count) {
+        printf("line bytes: min %zu, mean %.1f, max %zu; %zu lines larger than packed (%d bytes)\n",
+               min, (double)sum / line_count, max, over_packed, LINE / 2);
+    }
+    /* the largest lines, in decreasing order */
+    size_t costliest[COSTLIEST_SHOWN];
+    int shown = 0;
+    for (size_t l = 0; l < line_count; ++l) {
+        int k = shown < COSTLIEST_SHOWN ? shown++ : COSTLIEST_SHOWN;
+        while (k > 0 && lines[costliest[k - 1]].bytes < lines[l].bytes) {
+            if (k < COSTLIEST_SHOWN) costliest[k] = costliest[k - 1];
+            k--;
+        }
+        if (k < COSTLIEST_SHOWN) costliest[k] = l;
+    }
+    printf("costliest lines:");
+    for (int k = 0; k < shown; ++k) {
+        size_t l = costliest[k];
+        printf("%s %zu (row %zu col %zu) %u bytes", k ? "," : "", l, l / stats.cols, l % stats.cols,
+               lines[l].bytes);
+    }
+    printf("\n");
+
+    /* where the walk loses the 320-pixel grid */
+    size_t stalled = 0;
+    for (size_t l = 0; l < line_count; ++l) {
+        if (lines[l].pixels == LINE) continue;
+        if (stalled++ < STALLED_SHOWN) {
+            printf("stalled line %zu at offset %zu: runs cover %u pixels, the last %u are dropped\n",
+                   l, lines[l].offset, lines[l].pixels, lines[l].pixels - LINE);
+        }
+    }
+    if (stalled > STALLED_SHOWN) printf("... %zu stalled lines in all\n", stalled);
+    if (tail_bytes) {
+        stalled++;
+        printf("stalled end at offset %zu: %zu bytes cover only %zu pixels, not indexed\n",
+               size - tail_bytes, tail_bytes, tail_pixels);
+    }
+    if (line_count > rows * stats.cols) {
+        printf("%zu lines after line %zu are not shown\n", line_count - rows * stats.cols, rows * stats.cols);
+    }
+    if (!stalled) printf("no stalled lines\n");
+
+    if (list) {
+        printf("line,row,col,offset,bytes,pixels\n");
+        for (size_t l = 0; l < line_count; ++l) {
+            printf("%zu,%zu,%zu,%zu,%u,%u\n", l, l / stats.cols, l % stats.cols, lines[l].offset,
+                   lines[l].bytes, lines[l].pixels);
+        }
+    }
+
+    if (png && !render_png(png, zoom, has_view ? view : NULL)) {
+        fprintf(stderr, "%s: cannot write\n", png);
+        return 1;
+    }
+    viewer_free();
+    free(lines);
+    return stalled ? 2 : 0;
+}
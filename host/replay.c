@@ -0,0 +1,171 @@
+/* Plays a key trace (see src/trace.h) back through the viewer loop on the
+   host, headless, and prints the cost of every frame with a checksum of
+   the framebuffer once it is drawn, then the totals.
+
+   The simulated clock advances by loop_ms on every keyboard scan, i.e.
+   every iteration of the viewer loop, so a trace always replays the same
+   way however fast the build is; a wait for a key jumps to the next change
+   in the trace. settle_ms after the last change Home is pressed.
+
+   usage: replay [-m model] [-l loop_ms] [-s settle_ms] file.bin trace.csv */
+#define _POSIX_C_SOURCE 199309L
+#include "eadk_stub.h"
+#include "viewer.h"
+#include "app.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define TRACE_GROW 256
+
+static uint32_t *trace_time = NULL;
+static eadk_keyboard_state_t *trace_keys = NULL;
+static size_t trace_count = 0;
+static size_t trace_next = 0;
+static eadk_keyboard_state_t keys = 0;
+static uint32_t loop_ms = 10;
+static uint32_t settle_ms = 2000;
+static int finished = 0;
+/* clock time of t_ms 0, when app_run() starts, as trace_begin() on device */
+static uint64_t origin = 0;
+
+/* cost since the last frame */
+static struct viewer_stats last_stats;
+static struct stub_counters last_calls;
+static double last_us = 0.0;
+static double total_us = 0.0;
+
+static double now_us(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e6 + ts.tv_nsec / 1e3;
+}
+
+static int load_trace(const char *path) {
+    FILE *f = fopen(path, "r");
+    if (!f) return 0;
+    char line[128];
+    size_t cap = 0;
+    while (fgets(line, sizeof(line), f)) {
+        unsigned long t;
+        unsigned long long k;
+        if (sscanf(line, "%lu,%llx", &t, &k) != 2) continue;
+        if (trace_count == cap) {
+            cap += TRACE_GROW;
+            trace_time = (uint32_t*)realloc(trace_time, cap * sizeof(uint32_t));
+            trace_keys = (eadk_keyboard_state_t*)realloc(trace_keys, cap * sizeof(eadk_keyboard_state_t));
+            if (!trace_time || !trace_keys) {
+                fclose(f);
+                return 0;
+            }
+        }
+        trace_time[trace_count] = (uint32_t)t;
+        trace_keys[trace_count] = (eadk_keyboard_state_t)k;
+        trace_count++;
+    }
+    fclose(f);
+    return 1;
+}
+
+/* clock time of change i, or of pressing Home for i == trace_count */
+static uint64_t change_time(size_t i) {
+    if (i < trace_count) return origin + trace_time[i];
+    return origin + (trace_count ? trace_time[trace_count - 1] : 0) + settle_ms;
+}
+
+/* Applies the changes up to now; past the end of the trace, Home is held. */
+static void trace_catch_up(void) {
+    uint64_t now = eadk_timing_millis();
+    while (trace_next < trace_count && change_time(trace_next) <= now) keys = trace_keys[trace_next++];
+    if (trace_next == trace_count && now >= change_time(trace_count)) {
+        keys = (eadk_keyboard_state_t)1 << eadk_key_home;
+        finished = 1;
+    }
+}
+
+static void report_frames(void) {
+    struct viewer_stats stats;
+    viewer_get_stats(&stats);
+    if (stats.frames == last_stats.frames) return;
+    double now = now_us();
+    printf("%6lu %8llu %10.0f %10lu %8lu %7lu %7lu  %08lx\n", stats.frames,
+           (unsigned long long)eadk_timing_millis(), now - last_us,
+           stats.bytes_decoded - last_stats.bytes_decoded, stats.rows_decoded - last_stats.rows_decoded,
+           stub_counters.push_calls - last_calls.push_calls, stub_counters.pull_calls - last_calls.pull_calls,
+           (unsigned long)stub_framebuffer_checksum());
+    total_us += now - last_us;
+    last_us = now;
+    last_stats = stats;
+    last_calls = stub_counters;
+}
+
+static eadk_keyboard_state_t replay_scan(void) {
+    report_frames();
+    stub_clock_advance(loop_ms);
+    trace_catch_up();
+    return keys;
+}
+
+static eadk_event_t replay_event(int32_t *timeout) {
+    report_frames();
+    uint64_t now = eadk_timing_millis();
+    uint64_t next = change_time(trace_next);
+    if (finished) return (eadk_event_t)eadk_key_home;
+    if (next > now + (uint64_t)*timeout) {
+        stub_clock_advance((uint32_t)*timeout);
+        return (eadk_event_t)0xFFFF;
+    }
+    stub_clock_advance((uint32_t)(next - now));
+    eadk_keyboard_state_t before = keys;
+    trace_catch_up();
+    eadk_keyboard_state_t pressed = keys & ~before;
+    for (int k = 0; k < 64; ++k) {
+        if (pressed & ((eadk_keyboard_state_t)1 << k)) return (eadk_event_t)k;
+    }
+    return (eadk_event_t)0xFFFF;
+}
+
+int main(int argc, char **argv) {
+    const char *paths[2] = { NULL, NULL };
+    int n = 0;
+    for (int i = 1; i < argc; ++i) {
+        if (!strcmp(argv[i], "-m") && i + 1 < argc) stub_set_model((uint8_t)atoi(argv[++i]));
+        else if (!strcmp(argv[i], "-l") && i + 1 < argc) loop_ms = (uint32_t)atoi(argv[++i]);
+        else if (!strcmp(argv[i], "-s") && i + 1 < argc) settle_ms = (uint32_t)atoi(argv[++i]);
+        else if (n < 2) paths[n++] = argv[i];
+    }
+    if (n != 2) {
+        fprintf(stderr, "usage: %s [-m model] [-l loop_ms] [-s settle_ms] file.bin trace.csv\n", argv[0]);
+        return 1;
+    }
+    if (!stub_load_external_data(paths[0])) {
+        fprintf(stderr, "%s: cannot read\n", paths[0]);
+        return 1;
+    }
+    if (!load_trace(paths[1])) {
+        fprintf(stderr, "%s: cannot read\n", paths[1]);
+        return 1;
+    }
+
+    while (viewer_prepare_step()) {}
+    if (viewer_status() != VIEWER_READY) {
+        printf("%s: %s\n", paths[0], viewer_status() == VIEWER_EMPTY ? "empty" : "out of memory");
+        return viewer_status() == VIEWER_EMPTY ? 0 : 1;
+    }
+    printf("%s with %s: %zu key changes\n", paths[0], paths[1], trace_count);
+    printf("%6s %8s %10s %10s %8s %7s %7s  %8s\n", "frame", "t_ms", "us", "bytes", "rows",
+           "pushes", "pulls", "checksum");
+
+    viewer_get_stats(&last_stats);
+    last_calls = stub_counters;
+    last_us = now_us();
+    stub_scan_hook = replay_scan;
+    stub_event_hook = replay_event;
+    origin = eadk_timing_millis();
+    app_run();
+
+    printf("total: %lu frames, %.0f us, last checksum %08lx\n", last_stats.frames, total_us,
+           (unsigned long)stub_framebuffer_checksum());
+    return 0;
+}
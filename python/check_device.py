@@ -0,0 +1,117 @@
+"""Checks that the device view of the web editor draws a sheet exactly as
+the calculator does: deviceRenderRow() of docs/device.js, run with node,
+against the viewer itself through host/inspect -v, at several views and
+quarter-step zooms, on the sheet and on a copy whose stream is cut short.
+Needs `make output/host/inspect` first.
+
+usage: check_device.py [sheet.bin]    (exits with 1 on any difference)"""
+import re
+import struct
+import subprocess
+import sys
+import tempfile
+from pathlib import Path
+
+import numpy as np
+from PIL import Image
+
+ROOT = Path(__file__).resolve().parent.parent
+INSPECT = ROOT / 'output' / 'host' / 'inspect'
+HOTSPOT_RECORD_SIZE = 16 + 12 + 240 * 4
+
+ZOOMS = [4, 5, 8, 11, 16]  # in quarters
+
+# deviceRenderRow() over the views given as x,y,zoom4, as palette indices
+NODE_SCRIPT = r'''
+const fs = require('fs'), vm = require('vm');
+vm.runInThisContext(fs.readFileSync(process.argv[1], 'utf8'));
+const data = new Uint8Array(fs.readFileSync(process.argv[2]));
+const [cols, rows, pixelBytes] = process.argv.slice(3, 6).map(Number);
+const d = {
+  data: data, pixelBytes: pixelBytes, w: cols * 320, h: rows, cols: cols,
+  segOffsets: deviceSegments(data, pixelBytes, [0], rows * cols), frame: new Uint16Array(320 * 240)
+};
+for(const view of process.argv.slice(6)){
+  const [x, y, zoom4] = view.split(',').map(Number);
+  d.x = x; d.y = y; d.scale = zoom4 / 4;
+  for(let sy=0; sy<240; sy++) deviceRenderRow(d, sy);
+  const out = new Uint8Array(320 * 240);
+  for(let i=0; i<out.length; i++) out[i] = DEVICE_PALETTE.indexOf(d.frame[i]);
+  process.stdout.write(out);
+}
+'''
+
+
+def pixel_bytes(data):
+    """Size of the pixel stream in front of the trailer, if any."""
+    if len(data) >= 8 and data[-4:] == b'CSHS':
+        trailer = int.from_bytes(data[-8:-6], 'little') * HOTSPOT_RECORD_SIZE + 8
+        if trailer <= len(data):
+            return len(data) - trailer
+    return len(data)
+
+
+def cut_offset(data, cols, rows):
+    """Offset in the middle of the first line of a row three fifths down, so
+    that the whole lines before it still make rows of cols lines."""
+    pixels = np.cumsum((np.frombuffer(data, dtype=np.uint8) >> 4).astype(np.int64) + 1)
+    start = int(np.searchsorted(pixels, (rows * 3 // 5) * cols * 320)) + 1
+    end = int(np.searchsorted(pixels, pixels[start - 1] + 320)) + 1
+    return (start + end) // 2
+
+
+def layout(path):
+    """cols and rows the viewer settles on."""
+    out = subprocess.run([str(INSPECT), str(path)], stdout=subprocess.PIPE, text=True).stdout
+    m = re.search(r'layout: (\d+) cols .*?, (\d+) rows', out)
+    if not m:
+        sys.exit(f'{path}: not drawn by the viewer')
+    return int(m.group(1)), int(m.group(2))
+
+
+def viewer_screen(path, x, y, zoom4, png):
+    subprocess.run([str(INSPECT), '-z', str(zoom4 / 4), '-v', f'{x},{y}', '-o', str(png), str(path)],
+                   stdout=subprocess.DEVNULL)
+    return np.asarray(Image.open(png))
+
+
+def check(path, tmp):
+    data = path.read_bytes()
+    cols, rows = layout(path)
+    w = cols * 320
+    views = [(0, 0), (37, 91), (w // 2 - 101, rows // 2 + 13), (-50, -20), (w - 150, rows - 100)]
+    args = [f'{x},{y},{z}' for z in ZOOMS for x, y in views]
+    out = subprocess.run(['node', '-e', NODE_SCRIPT, str(ROOT / 'docs' / 'device.js'), str(path),
+                          str(cols), str(rows), str(pixel_bytes(data))] + args,
+                         stdout=subprocess.PIPE, check=True).stdout
+    editor = np.frombuffer(out, dtype=np.uint8).reshape(len(args), 240, 320)
+    failed = False
+    for k, (x, y, z) in enumerate((x, y, z) for z in ZOOMS for x, y in views):
+        diff = np.count_nonzero(viewer_screen(path, x, y, z, tmp / 'view.png') != editor[k])
+        if diff:
+            print(f'{path.name}: view {x},{y} at zoom {z / 4}: {diff} pixels differ')
+            failed = True
+    print(f'{path.name}: {cols}x{rows} segments, {len(args)} views, {"differences" if failed else "same pixels"}')
+    return failed
+
+
+def main():
+    path = Path(sys.argv[1]) if len(sys.argv) > 1 else ROOT / 'sim' / 'input.bin'
+    if not INSPECT.exists():
+        sys.exit(f'{INSPECT} is missing: run make {INSPECT.relative_to(ROOT)}')
+    with tempfile.TemporaryDirectory() as tmp:
+        tmp = Path(tmp)
+        # the same sheet cut in the middle of a line, its columns kept in a
+        # trailer without hotspots
+        data = path.read_bytes()
+        cols, rows = layout(path)
+        cut = tmp / ('cut-' + path.name)
+        stream = data[:pixel_bytes(data)]
+        cut.write_bytes(stream[:cut_offset(stream, cols, rows)] + struct.pack('<HH4s', 0, cols, b'CSHS'))
+        failed = check(path, tmp)
+        failed = check(cut, tmp) or failed
+    sys.exit(1 if failed else 0)
+
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,61 @@
+"""Checks that the web editor dithers an image exactly as python/main.py
+--dither does: the same palette index for every pixel, at several grey
+levels, run biases and white thresholds. The editor's side is the code of
+docs/export-worker.js, run with node as the preview runs it.
+
+usage: check_dither.py [image]    (exits with 1 on any difference)"""
+import subprocess
+import sys
+from pathlib import Path
+
+import numpy as np
+from PIL import Image
+
+from main import Settings, quantise
+
+ROOT = Path(__file__).resolve().parent.parent
+
+# (levels, white or None, run bias)
+CASES = [(16, None, 0.75), (16, None, 0.0), (8, 240, 0.5), (7, None, 0.75), (4, 224, 0.95), (2, None, 0.35)]
+
+# makeDither() over the rows, greys as the preview stores them, then the
+# palette index the exporter gives each grey
+NODE_SCRIPT = r'''
+const fs = require('fs'), vm = require('vm');
+vm.runInThisContext(fs.readFileSync(process.argv[1], 'utf8'));
+const [w, h, levels, white, bias] = process.argv.slice(2).map(Number);
+const rgba = new Uint8Array(fs.readFileSync(0));
+const dither = makeDither(w, levels, white, bias);
+const lut = exportIndexLut(levels, false);
+const row = new Uint8Array(w), out = new Uint8Array(w * h);
+for(let y=0; y<h; y++){
+  dither(rgba, y, row);
+  for(let x=0; x<w; x++) out[y*w + x] = lut[Math.round(row[x]/(levels-1)*255)];
+}
+process.stdout.write(out);
+'''
+
+
+def editor_indices(rgb, levels, white, bias):
+    h, w, _ = rgb.shape
+    rgba = np.dstack([rgb, np.full((h, w), 255, np.uint8)])
+    out = subprocess.run(['node', '-e', NODE_SCRIPT, str(ROOT / 'docs' / 'export-worker.js'),
+                          str(w), str(h), str(levels), str(256 if white is None else white), repr(bias)],
+                         input=rgba.tobytes(), stdout=subprocess.PIPE, check=True).stdout
+    return np.frombuffer(out, dtype=np.uint8).reshape(h, w)
+
+
+def main():
+    path = Path(sys.argv[1]) if len(sys.argv) > 1 else ROOT / 'python' / 'image.png'
+    rgb = np.asarray(Image.open(path).convert('RGB'))
+    failed = False
+    for levels, white, bias in CASES:
+        settings = Settings(levels, white, 0, bias)
+        diff = np.count_nonzero(quantise(rgb, settings) != editor_indices(rgb, levels, white, bias))
+        print(f'{settings.describe()}: {diff} pixels differ')
+        failed = failed or diff > 0
+    sys.exit(1 if failed else 0)
+
+
+if __name__ == '__main__':
+    main()
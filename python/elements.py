@@ -0,0 +1,102 @@
+import csv
+import sys
+from decimal import Decimal
+from pathlib import Path
+
+GRID_W = 18
+GRID_H = 9
+MASS_SCALE = 10 ** 7
+ELECTRONEG_SCALE = 100
+
+
+def load_elements(path):
+    """Rows of elements.csv, in atomic number order."""
+    with open(path, 'r', encoding='utf-8', newline='') as f:
+        elements = list(csv.DictReader(f))
+    for e in elements:
+        for key in ('num', 'x', 'y', 'neutrons'):
+            e[key] = int(e[key])
+    elements.sort(key=lambda e: e['num'])
+    return elements
+
+
+class StringPool:
+    """Strings stored once, back to back, addressed by their offset."""
+
+    def __init__(self):
+        self.data = bytearray()
+        self.offsets = {}
+
+    def add(self, text):
+        if text not in self.offsets:
+            self.offsets[text] = len(self.data)
+            self.data += text.encode('ascii') + b'\0'
+        return self.offsets[text]
+
+
+def c_string(data):
+    """The pool as C string literals, one string per line."""
+    lines = []
+    for s in bytes(data).split(b'\0')[:-1]:
+        lines.append('  "%s\\0"' % s.decode('ascii').replace('\\', '\\\\').replace('"', '\\"'))
+    return '\n'.join(lines)
+
+
+def write_header(path, elements):
+    pool = StringPool()
+    entries = []
+    grid = [[-1] * GRID_W for _ in range(GRID_H)]
+    for i, e in enumerate(elements):
+        if not (0 <= e['x'] < GRID_W and 0 <= e['y'] < GRID_H) or grid[e['y']][e['x']] >= 0:
+            raise ValueError(f"{e['symbol']}: cell ({e['x']}, {e['y']}) is outside the table or taken")
+        grid[e['y']][e['x']] = i
+        mass = int(Decimal(e['mass']) * MASS_SCALE)
+        electroneg = Decimal(e['electroneg'])
+        electroneg = int(electroneg * ELECTRONEG_SCALE) if electroneg > 0 else 0
+        entries.append('  {%10d, %4d, %4d, %3d, %3d, %3d, %2d, %d}, // %s' % (
+            mass, pool.add(e['name']), pool.add(e['symbol']), electroneg,
+            e['num'], e['neutrons'], e['x'], e['y'], e['symbol']))
+    if len(pool.data) > 0xFFFF:
+        raise ValueError('string pool too large for 16-bit offsets')
+
+    with open(path, 'w', encoding='utf-8', newline='\n') as f:
+        f.write('// Generated by python/elements.py from assets/elements.csv, do not edit.\n')
+        f.write('#ifndef ELEMENTS_H\n#define ELEMENTS_H\n\n')
+        f.write('#define ELEMENT_COUNT %d\n' % len(elements))
+        f.write('#define ELEMENT_GRID_W %d\n' % GRID_W)
+        f.write('#define ELEMENT_GRID_H %d\n' % GRID_H)
+        f.write('// masse en 1/%d u, electronegativite en 1/%d (0 : inconnue)\n' % (MASS_SCALE, ELECTRONEG_SCALE))
+        f.write('#define ELEMENT_MASS_SCALE %dUL\n' % MASS_SCALE)
+        f.write('#define ELEMENT_ELECTRONEG_SCALE %d\n\n' % ELECTRONEG_SCALE)
+        f.write('struct ElementDef {\n'
+                '  uint32_t mass;\n'
+                '  uint16_t name;   // offsets dans element_strings\n'
+                '  uint16_t symbol;\n'
+                '  uint16_t electroneg;\n'
+                '  uint8_t num;\n'
+                '  uint8_t neutrons;\n'
+                '  uint8_t x;\n'
+                '  uint8_t y;\n'
+                '};\n\n')
+        f.write('static const char element_strings[] =\n%s;\n\n' % c_string(pool.data))
+        f.write('static const struct ElementDef elements[ELEMENT_COUNT] = {\n%s\n};\n\n' % '\n'.join(entries))
+        f.write('// element a chaque case (x, y) du tableau, -1 si la case est vide\n')
+        f.write('static const int8_t element_grid[ELEMENT_GRID_H][ELEMENT_GRID_W] = {\n')
+        for row in grid:
+            f.write('  {' + ', '.join('%3d' % v for v in row) + '},\n')
+        f.write('};\n\n#endif\n')
+
+
+def main():
+    if len(sys.argv) != 3:
+        print(f'Usage: {sys.argv[0]} elements.csv elements.h')
+        sys.exit(1)
+    try:
+        write_header(Path(sys.argv[2]), load_elements(Path(sys.argv[1])))
+    except ValueError as e:
+        print(e)
+        sys.exit(1)
+
+
+if __name__ == '__main__':
+    main()
@@ -1,8 +1,18 @@
+import argparse
+import json
+import math
 import os
+import struct
 import sys
+from collections import deque, namedtuple
+from multiprocessing import Pool
 from pathlib import Path
+
+import numpy as np
 from PIL import Image
 
+from rle import rle_encode
+
 
 def rgb_to_palette_index(rgb):
     r, g, b = rgb
@@ -27,29 +37,490 @@ def pack_indices_to_bytes(indices):
     return out
 
 
-def rle_encode(indices):
-    out = bytearray()
-    if not indices:
-        return out
-
-    cur = indices[0]
-    run = 1
-    for v in indices[1:]:
-        if v == cur and run < 16:
-            run += 1
+# Rows encoded per task; each band is quantised and encoded on its own, and
+# written out as soon as the bands before it are.
+BAND_ROWS = 240
+SEGMENT = 320
+
+
+class Settings(namedtuple('Settings', 'levels white denoise dither', defaults=(None,))):
+    """How the image is reduced before encoding: the number of grey levels,
+    the intensity from which pixels become white (None for none), the
+    denoise level (0 for none, see denoise()) and the run bias of dithering
+    in level steps (None for plain thresholds, see dither())."""
+    __slots__ = ()
+
+    def describe(self):
+        white = f'white from {self.white}' if self.white is not None else 'no white threshold'
+        denoise = f'denoise {self.denoise}' if self.denoise else 'no denoise'
+        text = f'{self.levels} levels, {white}, {denoise}'
+        if self.dither is not None:
+            text += f', dithered with run bias {self.dither:g}'
+        return text
+
+
+FULL_QUALITY = Settings(16, None, 0)
+
+# What fit_budget() tries at each resolution.
+BUDGET_LEVELS = (16, 12, 8, 6, 4, 3, 2)
+BUDGET_WHITE = (None, 240, 224)
+BUDGET_DENOISE = (0, 1, 2)
+# nearly always the smallest of them, tried alone first to skip sizes at
+# which nothing can fit
+COARSEST = Settings(2, 224, 2)
+# run bias of --dither, in level steps; from 1 on the error is never
+# corrected and tones drift
+DITHER_BIAS = 0.75
+
+
+def palette_lut(settings):
+    """Palette index of every r + g + b sum. At full quality it is the one
+    rgb_to_palette_index() computes (same float operations, round half to
+    even); fewer levels are spread evenly over the 16 palette entries as
+    the web editor has always spread them, halves rounded up."""
+    intensity = np.arange(766) / 3.0
+    if settings.white is not None:
+        intensity = np.where(intensity >= settings.white, 255.0, intensity)
+    if settings.levels == 16:
+        idx = np.rint(intensity / 255.0 * 15.0)
+    else:
+        top = settings.levels - 1
+        idx = np.floor(np.rint(intensity / 255.0 * top) / top * 15.0 + 0.5)
+    return np.clip(idx, 0, 15).astype(np.uint8)
+
+
+def rgb_sums(rgb):
+    return rgb.sum(axis=2, dtype=np.int32)
+
+
+def quantise(rgb, settings=FULL_QUALITY):
+    """Palette indices of an (h, w, 3) uint8 array."""
+    if settings.dither is not None:
+        idx = dither(rgb_sums(rgb), settings)
+    else:
+        idx = palette_lut(settings)[rgb_sums(rgb)]
+    if settings.denoise:
+        denoise(idx, settings.denoise)
+    return idx
+
+
+def dither(sums, settings):
+    """Palette indices of r + g + b sums by Floyd-Steinberg error diffusion
+    over settings.levels grey levels, biased towards runs: a pixel keeps the
+    level of the pixel to its left unless another level is closer by more
+    than settings.dither level steps, and the extra error is diffused like
+    the rest. At 0 this is plain error diffusion, often several times the
+    size of thresholds; at DITHER_BIAS smooth areas stay in runs while
+    gradients still dither, and a photo is about a quarter larger than with
+    thresholds for the same largest line.
+
+    A pixel depends on its left neighbour and the three above it, so all the
+    pixels of an anti-diagonal x + 2y are computed at once. The error a
+    pixel receives from above right is added before the one from its left,
+    in the order the web editor's row by row loop adds them, so both give
+    the same levels to the last bit (python/check_dither.py)."""
+    h, w = sums.shape
+    top = settings.levels - 1
+    step = 255.0 / top
+    intensity = sums / 3.0
+    if settings.white is not None:
+        intensity = np.where(intensity >= settings.white, 255.0, intensity)
+    bias = settings.dither * step
+    # one column of padding each side, one row below
+    error = np.zeros((h + 1, w + 2))
+    level = np.zeros((h, w), dtype=np.uint8)
+    rows = np.arange(h)
+    for t in range(w + 2 * (h - 1)):
+        ys = rows[max(0, (t - w + 2) // 2):t // 2 + 1]
+        xs = t - 2 * ys
+        v = intensity[ys, xs] + error[ys, xs + 1]
+        q = np.clip(np.rint(v / step), 0, top).astype(np.int64)
+        prev = level[ys, xs - 1]
+        keep = (xs > 0) & (np.abs(v - prev * step) <= np.abs(v - q * step) + bias)
+        q = np.where(keep, prev, q)
+        level[ys, xs] = q
+        e = v - q * step
+        error[ys + 1, xs] += e * (3 / 16)
+        error[ys, xs + 2] += e * (7 / 16)
+        error[ys + 1, xs + 1] += e * (5 / 16)
+        error[ys + 1, xs + 2] += e * (1 / 16)
+    return np.floor(level / top * 15.0 + 0.5).astype(np.uint8)
+
+
+def denoise(idx, level):
+    """Lengthens runs in place, along rows: a pixel between two equal
+    neighbours takes their value, then from level 2 so do two equal pixels.
+    Each pass reads the pixels as they were before it."""
+    a = idx.copy()
+    spot = (a[:, :-2] == a[:, 2:]) & (a[:, 1:-1] != a[:, :-2])
+    idx[:, 1:-1][spot] = a[:, :-2][spot]
+    if level >= 2:
+        a = idx.copy()
+        pair = (a[:, :-3] == a[:, 3:]) & (a[:, 1:-2] == a[:, 2:-1]) & (a[:, 1:-2] != a[:, :-3])
+        idx[:, 1:-2][pair] = a[:, :-3][pair]
+        idx[:, 2:-1][pair] = a[:, :-3][pair]
+
+
+def segment_runs(segments):
+    """Run starts, lengths and number of bytes of the runs of every row of an
+    (n, 320) index array, with a break forced at every segment start; a run
+    of L pixels takes ceil(L / 16) bytes."""
+    flat = segments.ravel()
+    breaks = np.empty(flat.size, dtype=bool)
+    breaks[0] = True
+    np.not_equal(flat[1:], flat[:-1], out=breaks[1:])
+    breaks[::segments.shape[1]] = True
+    starts = np.flatnonzero(breaks)
+    lengths = np.diff(np.append(starts, flat.size))
+    return starts, lengths, (lengths + 15) // 16
+
+
+def rle_encode_segments(segments):
+    """rle_encode() of every row of an (n, 320) index array, concatenated,
+    and the number of bytes of each row. The full bytes of a run come
+    first and the remainder last, as the scalar encoder emits them."""
+    n, width = segments.shape
+    starts, lengths, chunks = segment_runs(segments)
+    values = segments.ravel()[starts].astype(np.int64)
+    out = np.repeat((0xF0 | values).astype(np.uint8), chunks)
+    last = np.cumsum(chunks) - 1
+    out[last] = ((lengths - 16 * (chunks - 1) - 1) << 4 | values).astype(np.uint8)
+    seg_bytes = np.bincount(starts // width, weights=chunks, minlength=n).astype(np.int64)
+    return out.tobytes(), seg_bytes
+
+
+def as_segments(idx):
+    h, width = idx.shape
+    return idx.reshape(h * (width // SEGMENT), SEGMENT)
+
+
+def encode_band(rgb, settings=FULL_QUALITY):
+    """Encoded bytes of a band of rows and the number of bytes of each of
+    its 320-pixel segments, one row of the array per row of pixels."""
+    return encode_indices(quantise(rgb, settings))
+
+
+def encode_indices(idx):
+    """encode_band() of rows already quantised."""
+    data, seg_bytes = rle_encode_segments(as_segments(idx))
+    return data, seg_bytes.reshape(idx.shape[0], -1)
+
+
+def measure_band(rgb, candidates):
+    """For each candidate settings, the encoded size of a band, its largest
+    320-pixel line in bytes and the summed distance between the grey shown
+    and the source intensity, times 3."""
+    sums = rgb_sums(rgb)
+    results = []
+    base = None
+    for settings in candidates:
+        if base is None or settings[:2] != base[0]:
+            base = (settings[:2], palette_lut(settings)[sums])
+        idx = base[1]
+        if settings.denoise:
+            idx = idx.copy()
+            denoise(idx, settings.denoise)
+        segments = as_segments(idx)
+        starts, _, chunks = segment_runs(segments)
+        seg_bytes = np.bincount(starts // SEGMENT, weights=chunks, minlength=segments.shape[0])
+        error = np.abs(idx * np.int32(51) - sums).sum()
+        results.append((int(seg_bytes.sum()), int(seg_bytes.max()), int(error)))
+    return results
+
+
+def resize_error(im, scaled):
+    """Mean distance between the source intensity and that of the scaled
+    image blown back up, pixel for pixel."""
+    width, height = im.size
+    small = rgb_sums(np.asarray(scaled))
+    xs = np.arange(width) * scaled.size[0] // width
+    total = 0
+    for y, band in zip(range(0, height, BAND_ROWS), image_bands(im)):
+        ys = np.arange(y, y + band.shape[0]) * scaled.size[1] // height
+        total += int(np.abs(small[ys][:, xs] - rgb_sums(band)).sum())
+    return total / 3.0 / (width * height)
+
+
+def image_bands(im):
+    width, height = im.size
+    return (np.asarray(im.crop((0, y, width, min(y + BAND_ROWS, height))))
+            for y in range(0, height, BAND_ROWS))
+
+
+def map_bands(fn, bands, args=(), jobs=None):
+    """fn(band, *args) for every band, in order. Bands are handed to a pool
+    of processes with at most two per process in flight, so memory holds
+    the decoded image and a few bands whatever its size."""
+    jobs = jobs or os.cpu_count() or 1
+    if jobs == 1:
+        for band in bands:
+            yield fn(band, *args)
+        return
+    with Pool(jobs) as pool:
+        pending = deque()
+        for band in bands:
+            if len(pending) >= 2 * jobs:
+                yield pending.popleft().get()
+            pending.append(pool.apply_async(fn, (band,) + tuple(args)))
+        while pending:
+            yield pending.popleft().get()
+
+
+def encode_image(im, out, settings=FULL_QUALITY, jobs=None):
+    """Writes the pixel data of im to the file out, band by band, and
+    returns the byte offset of every row and the bytes of every segment
+    as a (rows, cols) array."""
+    row_offsets = []
+    seg_bytes = []
+    offset = 0
+    if settings.dither is None:
+        bands = map_bands(encode_band, image_bands(im), (settings,), jobs)
+    else:
+        # the error crosses band edges (no seam every BAND_ROWS rows), so the
+        # whole image is dithered before it is cut into bands
+        idx = quantise(np.asarray(im), settings)
+        bands = (encode_indices(idx[y:y + BAND_ROWS]) for y in range(0, idx.shape[0], BAND_ROWS))
+    for data, band_bytes in bands:
+        for n in band_bytes.sum(axis=1):
+            row_offsets.append(offset)
+            offset += int(n)
+        seg_bytes.append(band_bytes)
+        out.write(data)
+    return row_offsets, np.concatenate(seg_bytes).astype(np.int64)
+
+
+def budget_resolutions(width, height):
+    """Sizes in whole tiles from the image's own down to one tile, keeping
+    the aspect ratio as well as tiles allow."""
+    cols, rows = width // 320, height // 240
+    sizes = []
+    for c in range(cols, 0, -1):
+        r = max(1, round(rows * c / cols))
+        if (c, r) not in sizes:
+            sizes.append((c, r))
+    return [(c * 320, r * 240) for c, r in sizes]
+
+
+def fit_budget(im, budget, max_line=None, trailer_size=8, jobs=None):
+    """Looks for the settings and size that fit budget bytes (trailer
+    included) and, when given, lines of at most max_line bytes, the decode
+    cost of a screen row. The choice has the lowest mean grey error against
+    the source, counting what reducing the resolution loses. Smaller sizes
+    are not tried once full quality fits or once that loss alone is larger
+    than the best error found, and a size is skipped when even COARSEST
+    does not fit.
+
+    Returns the choice as (settings, size, (bytes, largest line, error)),
+    or Nones if nothing fits, then the per-size summary and the stats of
+    every settings at the chosen size for the report."""
+    candidates = [Settings(lv, wh, dn) for lv in BUDGET_LEVELS for wh in BUDGET_WHITE for dn in BUDGET_DENOISE]
+
+    def fits(stats):
+        return stats[0] + trailer_size <= budget and (max_line is None or stats[1] <= max_line)
+
+    def measure(scaled, settings, loss):
+        totals = [[0, 0, 0] for _ in settings]
+        for results in map_bands(measure_band, image_bands(scaled), (settings,), jobs):
+            for total, (n, line, error) in zip(totals, results):
+                total[0] += n
+                total[1] = max(total[1], line)
+                total[2] += error
+        pixels = scaled.size[0] * scaled.size[1]
+        return {c: (t[0], t[1], loss + t[2] / 3.0 / pixels) for c, t in zip(settings, totals)}
+
+    best = (None, None, None)
+    best_stats = {}
+    sizes = []
+    for size in budget_resolutions(*im.size):
+        scaled = im if size == im.size else im.resize(size, Image.BOX)
+        loss = resize_error(im, scaled) if scaled is not im else 0.0
+        if best[0] is not None and loss >= best[2][2]:
+            break
+        if not fits(measure(scaled, [COARSEST], loss)[COARSEST]):
+            sizes.append((size, 0, len(candidates), None))
             continue
-        out.append(((run - 1) << 4) | (cur & 0x0F))
-        cur = v
-        run = 1
+        stats = measure(scaled, candidates, loss)
+        fitting = [c for c in candidates if fits(stats[c])]
+        sizes.append((size, len(fitting), len(candidates), min((stats[c][2] for c in fitting), default=None)))
+        if fitting:
+            choice = min(fitting, key=lambda c: (stats[c][2], stats[c][0]))
+            if best[0] is None or stats[choice][2] < best[2][2]:
+                best = (choice, size, stats[choice])
+                best_stats = stats
+        if FULL_QUALITY in fitting:
+            break
+    return best, sizes, best_stats
+
+
+def print_budget_report(best, sizes, stats, budget, max_line, trailer_size):
+    settings, size, chosen = best
+    limit = f'{budget} bytes' + (f' with lines of at most {max_line} bytes' if max_line else '')
+    if settings is None:
+        print(f'Nothing fits {limit}, even at one tile')
+        return
+    print(f'Fitting {limit}: {settings.describe()} at {size[0]}x{size[1]}, '
+          f'{chosen[0] + trailer_size} bytes, largest line {chosen[1]} bytes, '
+          f'mean grey error {chosen[2]:.2f} of 255')
+    print(f'  {"size":>9} {"fit":>5} {"error":>6}')
+    for s, fits, total, error in sizes:
+        print(f'  {s[0]:>4}x{s[1]:<4} {fits:>2}/{total:<2} {error if error is not None else float("nan"):>6.2f}'
+              + (' <' if s == size else ''))
+    print(f'  at {size[0]}x{size[1]}, the best settings per level count:')
+    print(f'  {"levels":>6} {"white":>5} {"denoise":>7} {"bytes":>10} {"line":>5} {"error":>6}')
+    for levels in BUDGET_LEVELS:
+        row = [c for c in stats if c.levels == levels]
+        fits = [c for c in row if stats[c][0] + trailer_size <= budget and (max_line is None or stats[c][1] <= max_line)]
+        c = min(fits or row, key=lambda c: (stats[c][2], stats[c][0]))
+        n, line, error = stats[c]
+        mark = ' <' if c == settings else '' if fits else ' too large'
+        print(f'  {c.levels:>6} {c.white if c.white is not None else "-":>5} {c.denoise:>7} '
+              f'{n + trailer_size:>10} {line:>5} {error:>6.2f}{mark}')
+
+
+# The cost report estimates the decode of views at the scale the viewer
+# opens with (VIEWER_FIRST_SCALE): 320x240 screen pixels showing every 4th
+# pixel of 1280x960. On the heatmap the costliest segment of the sheet is
+# tinted COST_TINT red, the others in proportion to what they cost above a
+# blank segment (runs of 16: COST_FLOOR bytes), which is not tinted.
+VIEW_SCALE = 4
+COST_TINT = 0.8
+COST_FLOOR = SEGMENT // 16
+
+
+def view_origins(size, screen):
+    """Origins along one axis of the views that tile it at VIEW_SCALE, the
+    last clamped to the edge as the viewer clamps it."""
+    last = max(0, size - screen * VIEW_SCALE)
+    return list(range(0, last, screen * VIEW_SCALE)) + [last]
 
-    if run > 0:
-        out.append(((run - 1) << 4) | (cur & 0x0F))
 
+def view_costs(seg_bytes):
+    """{(x, y): bytes} that the viewer walks to draw each view: for every
+    screen row, the segments of its source row under the view, from their
+    start (a view's last segment is counted whole, so this is an upper
+    bound by less than a segment per row)."""
+    rows, cols = seg_bytes.shape
+    costs = {}
+    for vy in view_origins(rows, 240):
+        ys = vy + VIEW_SCALE * np.arange(240)
+        ys = ys[ys < rows]
+        for vx in view_origins(cols * SEGMENT, 320):
+            c0, c1 = vx // SEGMENT, min(cols, (vx + 319 * VIEW_SCALE) // SEGMENT + 1)
+            costs[(vx, vy)] = int(seg_bytes[ys, c0:c1].sum())
+    return costs
+
+
+def write_cost_report(im, seg_bytes, png_path):
+    """Heatmap of the bytes per segment over the sheet at a quarter of its
+    size to png_path, the bytes of every row and segment to the same name
+    in .csv, and the bytes per band and the cost of every view printed."""
+    rows, cols = seg_bytes.shape
+    small = np.asarray(im.convert('L').resize((max(1, im.size[0] // 4), max(1, rows // 4)), Image.BOX), dtype=np.float64)
+    ys = np.minimum(np.arange(small.shape[0]) * 4, rows - 1)
+    xs = np.minimum(np.arange(small.shape[1]) * 4 // SEGMENT, cols - 1)
+    full = max(COST_FLOOR + 1, int(seg_bytes.max()))
+    t = COST_TINT * np.maximum(0, seg_bytes[ys][:, xs] - COST_FLOOR) / (full - COST_FLOOR)
+    heat = np.stack([small * (1 - t) + 255 * t, small * (1 - t), small * (1 - t)], axis=2)
+    Image.fromarray(np.rint(heat).astype(np.uint8), 'RGB').save(png_path)
+
+    csv_path = png_path.with_suffix('.csv')
+    with open(csv_path, 'w') as f:
+        f.write('row,' + ','.join(f'col{c}' for c in range(cols)) + '\n')
+        for y in range(rows):
+            f.write(f'{y},' + ','.join(str(int(n)) for n in seg_bytes[y]) + '\n')
+
+    print(f'Cost map in {png_path} (reddest: {full} bytes per 320 pixels), bytes of every segment in {csv_path}')
+    print(f'Bytes per {BAND_ROWS}-row band and 320-pixel column:')
+    print('  ' + f'{"rows":>11}' + ''.join(f'{f"col{c}":>8}' for c in range(cols)) + f'{"total":>9}')
+    for y in range(0, rows, BAND_ROWS):
+        band = seg_bytes[y:y + BAND_ROWS].sum(axis=0)
+        print(f'  {y:>5}-{min(y + BAND_ROWS, rows) - 1:<5}' + ''.join(f'{int(n):>8}' for n in band) + f'{int(band.sum()):>9}')
+    costs = view_costs(seg_bytes)
+    worst = max(costs, key=costs.get)
+    print(f'Bytes decoded to draw each view at scale {VIEW_SCALE} (x across, y down):')
+    xs_view = sorted({x for x, _ in costs})
+    print('  ' + f'{"y":>5}' + ''.join(f'{x:>9}' for x in xs_view))
+    for vy in sorted({y for _, y in costs}):
+        print('  ' + f'{vy:>5}' + ''.join(f'{costs[(vx, vy)]:>9}' for vx in xs_view))
+    print(f'  costliest view at ({worst[0]}, {worst[1]}): {costs[worst]} bytes')
+
+
+HOTSPOT_MAGIC = b'CSHS'
+HOTSPOT_MAX = 9
+HOTSPOT_NAME_LEN = 16
+NO_OFFSET = 0xFFFFFFFF
+
+
+def hotspot_view(spot, width, height):
+    """Viewer position (x, y, zoom in quarters) that shows a hotspot rectangle.
+
+    Without an explicit zoom the rectangle is fitted to the screen. The view is
+    centred on the rectangle and clamped the same way the viewer clamps it.
+    """
+    x, y, w, h = spot['x'], spot['y'], spot['w'], spot['h']
+    max_zoom4 = max(4, int(min(width / 320.0, height / 240.0) * 4))
+    zoom = spot.get('zoom') or max(w / 320.0, h / 240.0)
+    zoom4 = min(max(int(math.ceil(zoom * 4)), 4), max_zoom4)
+    scale = zoom4 / 4.0
+    vx = int(math.floor(x + w / 2.0 - 160 * scale))
+    vy = int(math.floor(y + h / 2.0 - 120 * scale))
+    vx = max(0, min(vx, max(0, width - int(math.ceil(320 * scale)))))
+    vy = max(0, min(vy, max(0, height - int(math.ceil(240 * scale)))))
+    return vx, vy, zoom4
+
+
+def encode_trailer(spots, row_offsets, width, height):
+    """Trailer recording the layout, plus the hotspots with the offsets of the
+    rows of their first frame."""
+    out = bytearray()
+    spots = spots[:HOTSPOT_MAX]
+    for spot in spots:
+        vx, vy, zoom4 = hotspot_view(spot, width, height)
+        name = spot.get('name', '').encode('utf-8')[:HOTSPOT_NAME_LEN - 1]
+        out += name.ljust(HOTSPOT_NAME_LEN, b'\0')
+        out += struct.pack('<IIHH', vx, vy, zoom4, 0)
+        for s in range(240):
+            sy = int(math.floor(vy + s * zoom4 / 4.0))
+            out += struct.pack('<I', row_offsets[sy] if sy < height else NO_OFFSET)
+    out += struct.pack('<HH', len(spots), width // 320) + HOTSPOT_MAGIC
     return out
 
+
+def load_hotspots(path):
+    """Hotspots from a JSON list of {name, x, y, w, h[, zoom]} in image pixels."""
+    if not path.exists():
+        return []
+    with open(path, 'r', encoding='utf-8') as f:
+        spots = json.load(f)
+    if len(spots) > HOTSPOT_MAX:
+        print(f"Only the first {HOTSPOT_MAX} hotspots are kept (keys 1-9)")
+    return spots
+
+
+def scale_hotspots(spots, from_size, to_size):
+    sx, sy = to_size[0] / from_size[0], to_size[1] / from_size[1]
+    return [dict(spot, x=spot['x'] * sx, y=spot['y'] * sy, w=spot['w'] * sx, h=spot['h'] * sy) for spot in spots]
+
+
 def main():
     script_dir = Path(__file__).resolve().parent
-    img_path = script_dir / 'image.png'
+    parser = argparse.ArgumentParser(description='Encode an image into a cheatsheet file.')
+    parser.add_argument('image', nargs='?', default=script_dir / 'image.png', type=Path)
+    parser.add_argument('output', nargs='?', default=script_dir / 'input.bin', type=Path)
+    parser.add_argument('--budget', type=int, help='largest file size in bytes; grey levels, '
+                        'white threshold, denoise and then resolution are traded to fit it')
+    parser.add_argument('--max-line', type=int, help='with --budget, largest 320-pixel line in bytes '
+                        '(decode cost of a screen row on the calculator)')
+    parser.add_argument('--heatmap', type=Path, metavar='PNG',
+                        help='also write a map of the bytes per 320-pixel segment, a CSV of them, '
+                        'and print the bytes per band and the decode cost of each view')
+    parser.add_argument('--hotspots', type=Path, metavar='JSON',
+                        help='hotspots of the image (default: hotspots.json next to the image)')
+    parser.add_argument('--dither', type=float, nargs='?', const=DITHER_BIAS, metavar='BIAS',
+                        help='error diffusion instead of thresholds, keeping the previous level '
+                        f'within BIAS level steps to keep runs long (default {DITHER_BIAS})')
+    args = parser.parse_args()
+    img_path, bin_path = args.image, args.output
     if not img_path.exists():
         print(f"Fichier introuvable: {img_path}")
         sys.exit(1)
@@ -61,25 +532,40 @@ def main():
         print(f"Image size must be a multiple of 320x240 (got {width}x{height})")
         sys.exit(1)
 
-    pixels = list(im.getdata())
+    hotspots_path = args.hotspots or img_path.parent / 'hotspots.json'
+    if args.hotspots and not hotspots_path.exists():
+        print(f"Fichier introuvable: {hotspots_path}")
+        sys.exit(1)
+    hotspots = load_hotspots(hotspots_path)
+    settings = FULL_QUALITY
+    if args.dither is not None:
+        if args.budget:
+            print("--dither and --budget cannot be combined")
+            sys.exit(1)
+        if not 0 <= args.dither < 1:
+            print("The dither bias must be from 0 to below 1")
+            sys.exit(1)
+        settings = settings._replace(dither=args.dither)
+    if args.budget:
+        trailer_size = len(encode_trailer(hotspots, [0] * height, width, height))
+        best, sizes, stats = fit_budget(im, args.budget, args.max_line, trailer_size)
+        print_budget_report(best, sizes, stats, args.budget, args.max_line, trailer_size)
+        settings, size, _ = best
+        if settings is None:
+            sys.exit(1)
+        if size != im.size:
+            hotspots = scale_hotspots(hotspots, im.size, size)
+            im = im.resize(size, Image.BOX)
+            width, height = size
 
-    out = bytearray()
-    for y in range(height):
-        row_start = y * width
-        for x_chunk in range(0, width, 320):
-            x_end = min(x_chunk + 320, width)
-            line_indices = []
-            for x in range(x_chunk, x_end):
-                line_indices.append(rgb_to_palette_index(pixels[row_start + x]))
-            out.extend(rle_encode(line_indices))
-
-    data_bytes = bytes(out)
-
-    bin_path = script_dir / 'input.bin'
     with open(bin_path, 'wb') as bf:
-        bf.write(data_bytes)
+        row_offsets, seg_bytes = encode_image(im, bf, settings)
+        bf.write(encode_trailer(hotspots, row_offsets, width, height))
+        size = bf.tell()
 
-    print(f'Wrote {bin_path} ({len(data_bytes)} bytes)')
+    print(f'Wrote {bin_path} ({size} bytes)')
+    if args.heatmap:
+        write_cost_report(im, seg_bytes, args.heatmap)
 
 
 if __name__ == '__main__':
@@ -0,0 +1,106 @@
+import sys
+from pathlib import Path
+
+from elements import load_elements
+from rle import rle_encode
+
+# Area below the toolbar that periodic() draws into
+WIDTH = 320
+HEIGHT = 222
+
+TYPE_COLORS = {
+    'ALKALI_METAL': 0xffaa00,
+    'ALKALI_EARTH_METAL': 0xf6f200,
+    'LANTHANIDE': 0xffaa8b,
+    'ACTINIDE': 0xdeaacd,
+    'TRANSITION_METAL': 0xde999c,
+    'POST_TRANSITION_METAL': 0x9cbaac,
+    'METALLOID': 0x52ce8b,
+    'REACTIVE_NONMETAL': 0x00ee00,
+    'NOBLE_GAS': 0x8baaff,
+    'HALOGEN': 0x00debd,
+}
+UNKNOWN_COLOR = 0xeeeeee
+STROKE_COLOR = 0x525552
+WHITE = 0xffffff
+
+def rgb(c):
+    return (c >> 16) & 0xff, (c >> 8) & 0xff, c & 0xff
+
+
+def rgb24to16(c):
+    r, g, b = rgb(c)
+    return (((r * 32) // 256) << 11) | (((g * 64) // 256) << 5) | (b * 32 // 256)
+
+
+def atom_origin(x, y):
+    """Top-left corner of a cell, as drawCursor() computes it."""
+    return 6 + x * 17, (15 if y >= 7 else 6) + y * 17
+
+
+def render(elements):
+    """The static table, cells and the lanthanide/actinide connector, as rows
+    of palette indices. The symbols are left out: periodic.c draws them over
+    the cells with the system font, as the rest of the app is written."""
+    colors = [WHITE, STROKE_COLOR, UNKNOWN_COLOR] + list(dict.fromkeys(TYPE_COLORS.values()))
+    index = {c: i for i, c in enumerate(colors)}
+    pixels = [[index[WHITE]] * WIDTH for _ in range(HEIGHT)]
+
+    def rect(x, y, w, h, c):
+        for row in pixels[y:y + h]:
+            row[x:x + w] = [index[c]] * w
+
+    for e in elements:
+        ox, oy = atom_origin(e['x'], e['y'])
+        rect(ox, oy, 18, 18, STROKE_COLOR)
+        rect(ox + 1, oy + 1, 16, 16, TYPE_COLORS.get(e['type'], UNKNOWN_COLOR))
+
+    rect(48, 99, 2, 61, STROKE_COLOR)
+    rect(48, 141, 9, 2, STROKE_COLOR)
+    rect(48, 158, 9, 2, STROKE_COLOR)
+    return pixels, colors
+
+
+def encode(pixels):
+    """RLE lines in the viewer format, plus the byte offset of each line."""
+    out = bytearray()
+    rows = []
+    for row in pixels:
+        rows.append(len(out))
+        out.extend(rle_encode(row))
+    return out, rows
+
+
+def c_array(values, per_line, fmt):
+    lines = []
+    for i in range(0, len(values), per_line):
+        lines.append('  ' + ', '.join(fmt % v for v in values[i:i + per_line]) + ',')
+    return '\n'.join(lines)
+
+
+def write_header(path, data, rows, colors):
+    palette = [rgb24to16(c) for c in colors] + [0xffff] * (16 - len(colors))
+    with open(path, 'w', encoding='utf-8', newline='\n') as f:
+        f.write('// Generated by python/periodic_table.py from assets/elements.csv, do not edit.\n')
+        f.write('#ifndef PERIODIC_TABLE_H\n#define PERIODIC_TABLE_H\n\n')
+        f.write('#define PERIODIC_TABLE_HEIGHT %d\n\n' % HEIGHT)
+        f.write('static const uint16_t periodic_table_palette[16] = {\n%s\n};\n\n' % c_array(palette, 8, '0x%04X'))
+        f.write('static const uint16_t periodic_table_rows[PERIODIC_TABLE_HEIGHT] = {\n%s\n};\n\n' % c_array(rows, 12, '%d'))
+        f.write('static const uint8_t periodic_table_rle[%d] = {\n%s\n};\n\n' % (len(data), c_array(list(data), 16, '0x%02X')))
+        f.write('#endif\n')
+
+
+def main():
+    if len(sys.argv) != 3:
+        print(f'Usage: {sys.argv[0]} elements.csv periodic_table.h')
+        sys.exit(1)
+    pixels, colors = render(load_elements(Path(sys.argv[1])))
+    data, rows = encode(pixels)
+    if len(data) > 0xFFFF:
+        print(f"Table image too large for 16-bit row offsets ({len(data)} bytes)")
+        sys.exit(1)
+    write_header(Path(sys.argv[2]), data, rows, colors)
+
+
+if __name__ == '__main__':
+    main()
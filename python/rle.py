@@ -0,0 +1,25 @@
+"""The run-length format of cheatsheet files, one byte per run: the run
+length minus one in the high nibble, the palette index in the low one.
+Kept free of numpy and Pillow, so periodic_table.py can run in the device
+build."""
+
+
+def rle_encode(indices):
+    out = bytearray()
+    if not indices:
+        return out
+
+    cur = indices[0]
+    run = 1
+    for v in indices[1:]:
+        if v == cur and run < 16:
+            run += 1
+            continue
+        out.append(((run - 1) << 4) | (cur & 0x0F))
+        cur = v
+        run = 1
+
+    if run > 0:
+        out.append(((run - 1) << 4) | (cur & 0x0F))
+
+    return out
@@ -0,0 +1,329 @@
+#include "libs/eadk.h"
+#include "app.h"
+#include "trace.h"
+#include "viewer.h"
+#include <stdint.h>
+#include <math.h>
+
+/* Pan speed in screen pixels per second. It ramps from PAN_SPEED_MIN to
+   PAN_SPEED_MAX over PAN_RAMP_MS while a direction stays held, and is
+   integrated over real elapsed time so it doesn't depend on redraw cost. */
+#define PAN_SPEED_MIN 160.0
+#define PAN_SPEED_MAX 960.0
+#define PAN_RAMP_MS 1000
+#define PAN_FIRST_STEP_MS 100
+#define PAN_MAX_DT_MS 100
+#define ZOOM_REPEAT_MS 150
+#define IDLE_TIMEOUT_MS 1000
+#define ACTIVE_POLL_MS 10
+/* Pans move the view by whole multiples of PAN_QUANTUM screen pixels. At
+   quarter-step zooms this keeps the floor() sampling grid aligned, so a pan
+   just shifts which source rows are on screen. */
+#define PAN_QUANTUM 4
+#define MAP_SPEED 160.0
+#define MAP_FIRST_STEP_MS 50
+
+enum { OVERVIEW_CANCEL, OVERVIEW_JUMP, OVERVIEW_FIT, OVERVIEW_QUIT };
+
+/* hotspot h is opened with hotspot_keys[h] */
+static const eadk_key_t hotspot_keys[] = {
+    eadk_key_one, eadk_key_two, eadk_key_three,
+    eadk_key_four, eadk_key_five, eadk_key_six,
+    eadk_key_seven, eadk_key_eight, eadk_key_nine
+};
+
+static void overview_frame_rect(int x, int y, int w, int h) {
+    if (w < 3) w = 3;
+    if (h < 3) h = 3;
+    if (x + w > 320) x = 320 - w;
+    if (y + h > 240) y = 240 - h;
+    eadk_display_push_rect_uniform((eadk_rect_t){(uint16_t)x, (uint16_t)y, (uint16_t)w, 2}, eadk_color_red);
+    eadk_display_push_rect_uniform((eadk_rect_t){(uint16_t)x, (uint16_t)(y + h - 2), (uint16_t)w, 2}, eadk_color_red);
+    eadk_display_push_rect_uniform((eadk_rect_t){(uint16_t)x, (uint16_t)y, 2, (uint16_t)h}, eadk_color_red);
+    eadk_display_push_rect_uniform((eadk_rect_t){(uint16_t)(x + w - 2), (uint16_t)y, 2, (uint16_t)h}, eadk_color_red);
+}
+
+/* Shows the overview as a map with the current viewport framed in red.
+   Arrows move the frame, OK jumps there at the current zoom, EXE keeps the
+   whole-sheet view and Back returns to where we were. */
+static int overview_navigate(int *view_x, int *view_y, double scale, eadk_keyboard_state_t held) {
+    double overview_scale = viewer_overview_scale();
+    double frame_x = *view_x / overview_scale;
+    double frame_y = *view_y / overview_scale;
+    int frame_w = (int)ceil(320.0 * scale / overview_scale);
+    int frame_h = (int)ceil(240.0 * scale / overview_scale);
+    double max_x = viewer_width() / overview_scale - frame_w;
+    double max_y = viewer_height() / overview_scale - frame_h;
+    if (max_x < 0) max_x = 0;
+    if (max_y < 0) max_y = 0;
+    int result = OVERVIEW_CANCEL;
+    int moving = 0;
+    uint64_t last_tick = 0;
+
+    viewer_overview_draw();
+    overview_frame_rect((int)frame_x, (int)frame_y, frame_w, frame_h);
+    while (1) {
+        eadk_keyboard_state_t st = trace_scan();
+        if (!st) {
+            moving = 0;
+            held = 0;
+            int32_t timeout = IDLE_TIMEOUT_MS;
+            eadk_event_t ev = trace_event_get(&timeout);
+            if (ev >= 64) continue;
+            st = trace_scan() | ((eadk_keyboard_state_t)1 << ev);
+        }
+        eadk_keyboard_state_t pressed = st & ~held;
+        held = st;
+        if (eadk_keyboard_key_down(st, eadk_key_home)) { result = OVERVIEW_QUIT; break; }
+        if (eadk_keyboard_key_down(pressed, eadk_key_back)) { result = OVERVIEW_CANCEL; break; }
+        if (eadk_keyboard_key_down(pressed, eadk_key_exe)) { result = OVERVIEW_FIT; break; }
+        if (eadk_keyboard_key_down(pressed, eadk_key_ok)) { result = OVERVIEW_JUMP; break; }
+
+        int dir_x = (int)eadk_keyboard_key_down(st, eadk_key_right) - (int)eadk_keyboard_key_down(st, eadk_key_left);
+        int dir_y = (int)eadk_keyboard_key_down(st, eadk_key_down) - (int)eadk_keyboard_key_down(st, eadk_key_up);
+        if (!dir_x && !dir_y) {
+            moving = 0;
+            eadk_timing_msleep(ACTIVE_POLL_MS);
+            continue;
+        }
+        uint64_t now = eadk_timing_millis();
+        if (!moving) {
+            moving = 1;
+            last_tick = now - MAP_FIRST_STEP_MS;
+        }
+        uint64_t dt = now - last_tick;
+        if (dt > PAN_MAX_DT_MS) dt = PAN_MAX_DT_MS;
+        last_tick = now;
+        double old_x = frame_x, old_y = frame_y;
+        frame_x += dir_x * MAP_SPEED * (double)dt / 1000.0;
+        frame_y += dir_y * MAP_SPEED * (double)dt / 1000.0;
+        if (frame_x < 0) frame_x = 0;
+        if (frame_y < 0) frame_y = 0;
+        if (frame_x > max_x) frame_x = max_x;
+        if (frame_y > max_y) frame_y = max_y;
+        if ((int)frame_x != (int)old_x || (int)frame_y != (int)old_y) {
+            viewer_overview_draw();
+            overview_frame_rect((int)frame_x, (int)frame_y, frame_w, frame_h);
+        } else {
+            eadk_timing_msleep(ACTIVE_POLL_MS);
+        }
+    }
+
+    /* leave a clean overview behind so it can seed the next frame */
+    viewer_overview_draw();
+    viewer_overview_as_frame();
+    if (result == OVERVIEW_JUMP) {
+        *view_x = (int)floor(frame_x * overview_scale);
+        *view_y = (int)floor(frame_y * overview_scale);
+    }
+    return result;
+}
+
+static double zoom_step(int *view_x, int *view_y, double scale, double delta, double max_scale) {
+    double center_x = (double)*view_x + (320.0 * scale) / 2.0;
+    double center_y = (double)*view_y + (240.0 * scale) / 2.0;
+    double new_scale = scale + delta;
+    if (new_scale > max_scale) new_scale = max_scale;
+    if (new_scale < 1.0) new_scale = 1.0;
+    *view_x = (int)floor(center_x - (320.0 * new_scale) / 2.0);
+    *view_y = (int)floor(center_y - (240.0 * new_scale) / 2.0);
+    return new_scale;
+}
+
+void app_run(void) {
+    eadk_display_push_rect_uniform(eadk_screen_rect, eadk_color_white);
+
+    if (viewer_status() == VIEWER_FAILED) return;
+    if (viewer_status() == VIEWER_EMPTY) {
+        /* nothing to show: sleep until a key wakes us, then look for Home */
+        while (!eadk_keyboard_key_down(eadk_keyboard_scan(), eadk_key_home)) {
+            int32_t timeout = IDLE_TIMEOUT_MS;
+            eadk_event_get(&timeout);
+        }
+        return;
+    }
+
+    int total_w = viewer_width();
+    int total_h = viewer_height();
+
+    int view_x = 0, view_y = 0;
+
+    double max_scale = (double)total_w / 320.0;
+    double max_scale_y = (double)total_h / 240.0;
+    if (max_scale_y < max_scale) max_scale = max_scale_y;
+    if (max_scale < 1.0) max_scale = 1.0; 
+    
+    double scale = VIEWER_FIRST_SCALE;
+
+    /* the first frame's offsets are cached and its top rows prefetched */
+    viewer_jump(view_x, view_y, scale);
+    trace_begin();
+
+    const eadk_keyboard_state_t nav_keys =
+        ((eadk_keyboard_state_t)1 << eadk_key_left) | ((eadk_keyboard_state_t)1 << eadk_key_right) |
+        ((eadk_keyboard_state_t)1 << eadk_key_up) | ((eadk_keyboard_state_t)1 << eadk_key_down) |
+        ((eadk_keyboard_state_t)1 << eadk_key_ok) | ((eadk_keyboard_state_t)1 << eadk_key_back) |
+        ((eadk_keyboard_state_t)1 << eadk_key_home) | ((eadk_keyboard_state_t)1 << eadk_key_exe);
+    eadk_keyboard_state_t hotspot_mask = 0;
+    for (size_t h = 0; h < viewer_hotspot_count(); ++h) hotspot_mask |= (eadk_keyboard_state_t)1 << hotspot_keys[h];
+
+    int panning = 0;
+    uint64_t pan_start = 0;
+    uint64_t last_tick = 0;
+    uint64_t next_zoom = 0;
+    double pan_acc_x = 0.0, pan_acc_y = 0.0;
+    /* keys still held from closing the overview, ignored until released */
+    eadk_keyboard_state_t swallowed = 0;
+
+#if VIEWER_DEBUG
+    int hud_visible = 0;
+#endif
+
+    while (1) {
+
+#if VIEWER_DEBUG
+        if (hud_visible) viewer_hud_draw();
+#endif
+
+        eadk_keyboard_state_t st = trace_scan();
+        swallowed &= st;
+        st &= ~swallowed;
+        if (!(st & (nav_keys | hotspot_mask))) {
+            /* Nothing held: sleep in the event queue instead of spinning on the
+               keyboard. A key event that was already released by the time we
+               scan still counts as one press. */
+            panning = 0;
+            next_zoom = 0;
+            /* refine the current view one band at a time, then prefetch one
+               row at a time, rescanning the keyboard in between */
+            if (viewer_render_step()) continue;
+            if (viewer_prefetch_step()) continue;
+            int32_t timeout = IDLE_TIMEOUT_MS;
+            eadk_event_t ev = trace_event_get(&timeout);
+#if VIEWER_DEBUG
+            if (ev == eadk_event_var) {
+                /* hidden HUD toggle; hiding it also saves the profile log */
+                hud_visible = !hud_visible;
+                if (!hud_visible) {
+                    viewer_profile_flush();
+                    viewer_refresh();
+                }
+                continue;
+            }
+#endif
+            if (ev >= 64) continue;
+            st = trace_scan() | ((eadk_keyboard_state_t)1 << ev);
+        }
+        if (eadk_keyboard_key_down(st, eadk_key_home)) break;
+
+        uint64_t now = eadk_timing_millis();
+        int old_view_x = view_x, old_view_y = view_y;
+        int zoomed = 0;
+
+        if (eadk_keyboard_key_down(st, eadk_key_exe)) {
+            if (viewer_overview_scale() > 0.0) {
+                int result = overview_navigate(&view_x, &view_y, scale, st);
+                if (result == OVERVIEW_QUIT) break;
+                swallowed = trace_scan();
+                if (result == OVERVIEW_FIT) {
+                    scale = max_scale;
+                    view_x = view_y = 0;
+                }
+                panning = 0;
+                next_zoom = 0;
+                /* the overview is on screen now, so the view always changes */
+                zoomed = 1;
+            } else if (scale != max_scale) {
+                scale = max_scale;
+                view_x = view_y = 0;
+                zoomed = 1;
+            }
+            st &= ~((eadk_keyboard_state_t)1 << eadk_key_exe);
+        }
+
+        int jump = -1;
+        for (size_t h = 0; h < viewer_hotspot_count(); ++h) {
+            if (!eadk_keyboard_key_down(st, hotspot_keys[h])) continue;
+            double hotspot_scale;
+            viewer_hotspot_view(h, &view_x, &view_y, &hotspot_scale);
+            if (hotspot_scale > max_scale) hotspot_scale = max_scale;
+            if (hotspot_scale < 1.0) hotspot_scale = 1.0;
+            if (hotspot_scale != scale) zoomed = 1;
+            scale = hotspot_scale;
+            jump = (int)h;
+            break;
+        }
+
+        int dir_x = (int)eadk_keyboard_key_down(st, eadk_key_right) - (int)eadk_keyboard_key_down(st, eadk_key_left);
+        int dir_y = (int)eadk_keyboard_key_down(st, eadk_key_down) - (int)eadk_keyboard_key_down(st, eadk_key_up);
+        if (dir_x || dir_y) {
+            if (!panning) {
+                panning = 1;
+                pan_start = now;
+                last_tick = now - PAN_FIRST_STEP_MS;
+                pan_acc_x = pan_acc_y = 0.0;
+            }
+            uint64_t dt = now - last_tick;
+            if (dt > PAN_MAX_DT_MS) dt = PAN_MAX_DT_MS;
+            uint64_t held = now - pan_start;
+            if (held > PAN_RAMP_MS) held = PAN_RAMP_MS;
+            double speed = PAN_SPEED_MIN + (PAN_SPEED_MAX - PAN_SPEED_MIN) * (double)held / PAN_RAMP_MS;
+            double step = speed * (double)dt / 1000.0 * scale;
+            pan_acc_x += dir_x * step;
+            pan_acc_y += dir_y * step;
+            int quantum = (int)(PAN_QUANTUM * scale + 0.5);
+            int dx = (int)(pan_acc_x / quantum) * quantum;
+            int dy = (int)(pan_acc_y / quantum) * quantum;
+            pan_acc_x -= dx;
+            pan_acc_y -= dy;
+            if (dir_y) viewer_prefetch_direction(dir_y);
+            view_x += dx;
+            view_y += dy;
+            last_tick = now;
+        } else {
+            panning = 0;
+        }
+
+        int zoom_out = eadk_keyboard_key_down(st, eadk_key_back);
+        int zoom_in = eadk_keyboard_key_down(st, eadk_key_ok);
+        if ((zoom_out || zoom_in) && now >= next_zoom) {
+            if (zoom_out && scale < max_scale) {
+                scale = zoom_step(&view_x, &view_y, scale, 0.25, max_scale);
+                zoomed = 1;
+            }
+            if (zoom_in && scale > 1.0) {
+                scale = zoom_step(&view_x, &view_y, scale, -0.25, max_scale);
+                zoomed = 1;
+            }
+            next_zoom = now + ZOOM_REPEAT_MS;
+        } else if (!zoom_out && !zoom_in) {
+            next_zoom = 0;
+        }
+
+        int max_view_x = total_w - (int)ceil(320.0 * scale);
+        int max_view_y = total_h - (int)ceil(240.0 * scale);
+        if (max_view_x < 0) max_view_x = 0;
+        if (max_view_y < 0) max_view_y = 0;
+        if (view_x < 0) view_x = 0;
+        if (view_y < 0) view_y = 0;
+        if (view_x > max_view_x) view_x = max_view_x;
+        if (view_y > max_view_y) view_y = max_view_y;
+
+        if (jump >= 0 && (zoomed || view_x != old_view_x || view_y != old_view_y)) {
+            viewer_hotspot_seed((size_t)jump, view_y, scale);
+            viewer_jump(view_x, view_y, scale);
+        } else if (zoomed || view_x != old_view_x || view_y != old_view_y) {
+            viewer_set_view(view_x, view_y, scale);
+        }
+        if (!viewer_render_step()) {
+            /* held against an edge or between zoom repeats */
+            eadk_timing_msleep(ACTIVE_POLL_MS);
+        }
+    }
+
+#if VIEWER_DEBUG
+    viewer_profile_flush();
+#endif
+    viewer_free();
+    trace_save();
+}
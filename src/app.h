@@ -0,0 +1,8 @@
+#ifndef APP_H
+#define APP_H
+
+/* Keyboard loop of the viewer, once viewer_prepare_step() is done: pans,
+   zooms, the overview map and hotspot keys, until Home is pressed. */
+void app_run(void);
+
+#endif
@@ -1,6 +1,10 @@
 #ifndef PERIODIC_H
 #define PERIODIC_H
 
-void periodic();
+#include <stdint.h>
 
-#endif
\ No newline at end of file
+// Ecran de couverture. Pendant l'attente des touches, background(budget_ms)
+// est appele par tranches d'environ budget_ms tant qu'il renvoie non nul.
+void periodic(int (*background)(uint32_t budget_ms));
+
+#endif
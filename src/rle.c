@@ -0,0 +1,20 @@
+#include "rle.h"
+
+size_t rle_decode_span(const uint8_t *data, size_t size, size_t off, int x, int w,
+                       const uint16_t *palette, eadk_color_t *out) {
+    int end = x + w;
+    int pixel = 0;
+    while (off < size && pixel < end) {
+        uint8_t b = data[off++];
+        int run_end = pixel + (b >> 4) + 1;
+        if (run_end > x) {
+            eadk_color_t color = palette[b & 0x0F];
+            int from = pixel > x ? pixel : x;
+            int to = run_end < end ? run_end : end;
+            for (int i = from; i < to; ++i) out[i - x] = color;
+        }
+        pixel = run_end;
+    }
+    for (int i = pixel > x ? pixel : x; i < end; ++i) out[i - x] = eadk_color_white;
+    return off;
+}
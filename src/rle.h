@@ -0,0 +1,14 @@
+#ifndef RLE_H
+#define RLE_H
+
+#include "libs/eadk.h"
+
+/* Decodes pixels [x, x + w) of the 320-pixel RLE line that starts at
+   data[off], each byte being (run - 1) << 4 | palette index. Runs before x
+   are skipped without being expanded. Pixels past the end of the stream
+   (or an off of SIZE_MAX) are white. Returns the offset just past the last
+   byte read. */
+size_t rle_decode_span(const uint8_t *data, size_t size, size_t off, int x, int w,
+                       const uint16_t *palette, eadk_color_t *out);
+
+#endif
@@ -0,0 +1,65 @@
+#include "trace.h"
+
+#if VIEWER_TRACE
+#include "libs/storage.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+/* Entries are kept in a static array so recording doesn't take from the
+   heap the viewer budgets; once it is full the rest of the session is lost
+   and the record says so. */
+#define TRACE_MAX 512
+#define TRACE_LINE_CHARS 32
+
+static uint32_t trace_time[TRACE_MAX];
+static eadk_keyboard_state_t trace_keys[TRACE_MAX];
+static int trace_count = 0;
+static int trace_truncated = 0;
+static uint64_t trace_start = 0;
+static eadk_keyboard_state_t trace_last = 0;
+
+static void trace_record(eadk_keyboard_state_t keys) {
+    if (keys == trace_last) return;
+    trace_last = keys;
+    if (trace_count == TRACE_MAX) {
+        trace_truncated = 1;
+        return;
+    }
+    trace_time[trace_count] = (uint32_t)(eadk_timing_millis() - trace_start);
+    trace_keys[trace_count] = keys;
+    trace_count++;
+}
+
+void trace_begin(void) {
+    trace_start = eadk_timing_millis();
+    trace_count = 0;
+    trace_truncated = 0;
+    trace_last = 0;
+}
+
+eadk_keyboard_state_t trace_scan(void) {
+    eadk_keyboard_state_t keys = eadk_keyboard_scan();
+    trace_record(keys);
+    return keys;
+}
+
+eadk_event_t trace_event_get(int32_t *timeout) {
+    eadk_event_t ev = eadk_event_get(timeout);
+    if (ev < 64) trace_record(trace_last | ((eadk_keyboard_state_t)1 << ev));
+    return ev;
+}
+
+void trace_save(void) {
+    size_t cap = 64 + (size_t)trace_count * TRACE_LINE_CHARS;
+    char *text = (char*)malloc(cap);
+    if (!text) return;
+    size_t len = (size_t)snprintf(text, cap, "t_ms,keys\n");
+    for (int i = 0; i < trace_count; ++i) {
+        len += (size_t)snprintf(text + len, cap - len, "%lu,%llx\n",
+                                (unsigned long)trace_time[i], (unsigned long long)trace_keys[i]);
+    }
+    if (trace_truncated) len += (size_t)snprintf(text + len, cap - len, "# truncated\n");
+    extapp_fileWrite(TRACE_RECORD, text, len);
+    free(text);
+}
+#endif
@@ -0,0 +1,31 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include "libs/eadk.h"
+
+/* set to 1 to record the keyboard input of the viewer loop */
+#ifndef VIEWER_TRACE
+#define VIEWER_TRACE 0
+#endif
+
+/* Keyboard input of the viewer loop. In VIEWER_TRACE builds each change of
+   the key state is recorded with its time since trace_begin(), and
+   trace_save() writes them to the TRACE_RECORD storage record as CSV lines
+   t_ms,keys (the eadk_keyboard_state_t in hex). A key only seen as an event
+   is recorded as held from then until the next scan. host/replay.c plays a
+   trace back. */
+#define TRACE_RECORD "trace.csv"
+
+#if VIEWER_TRACE
+void trace_begin(void);
+eadk_keyboard_state_t trace_scan(void);
+eadk_event_t trace_event_get(int32_t *timeout);
+void trace_save(void);
+#else
+static inline void trace_begin(void) {}
+static inline eadk_keyboard_state_t trace_scan(void) { return eadk_keyboard_scan(); }
+static inline eadk_event_t trace_event_get(int32_t *timeout) { return eadk_event_get(timeout); }
+static inline void trace_save(void) {}
+#endif
+
+#endif
@@ -0,0 +1,1361 @@
+#include "libs/eadk.h"
+#include "libs/storage.h"
+#include "viewer.h"
+#include "rle.h"
+#include <stdlib.h>
+#include <stdint.h>
+#include <limits.h>
+#include <math.h>
+
+static const uint16_t grayscale_palette[16] = {
+    0x0000, 0x1082, 0x2104, 0x3186,
+    0x4228, 0x52AA, 0x632C, 0x73AE,
+    0x8C51, 0x9CD3, 0xAD55, 0xBDD7,
+    0xCE79, 0xDE7B, 0xEF7D, 0xFFFF
+};
+
+/* One band of the progressive renderer. Input is checked between bands, so
+   this bounds how long a key press can wait before it is acted on. The
+   height is band_height, at most BUFFER_HEIGHT, and always divides 240. */
+#define BUFFER_HEIGHT 40
+#define BUFFER_WIDTH 320
+static eadk_color_t *line_buffer = NULL;
+static int band_height = BUFFER_HEIGHT;
+static int buffer_y_start = 0;
+static int buffer_line_count = 0;
+
+/* offsets of the column segments of one source row, sheet_cols entries */
+static size_t *row_offsets = NULL;
+
+static int source_y_lookup[240];
+static int source_y_lookup_valid = 0;
+/* scan hint to allow incremental scanning across successive rows */
+static size_t scan_hint_idx = 0;
+static size_t scan_hint_off = 0;
+static int scan_hint_valid = 0;
+/* direct-mapped cache of row offsets, large enough to hold every row of a
+   view so horizontal pans and prefetch never walk the index twice. Slots
+   use Fibonacci hashing because on-screen rows are spaced scale rows apart.
+   A slot holds one offset per column, so the cache is allocated once the
+   layout is known, with as many slots (a power of two) as its share of the
+   memory budget allows; without it every lookup misses. */
+#define ROW_CACHE_MIN 64
+#define ROW_CACHE_MAX 2048
+#define ROW_CACHE_SLOT(y) ((size_t)(((uint32_t)(y) * 2654435761u) >> (32 - row_cache_bits)))
+static size_t *row_cache_keys = NULL;
+static size_t *row_cache_offsets = NULL;
+static size_t row_cache_size = 0;
+static int row_cache_bits = 0;
+static unsigned long row_cache_hits = 0;
+static unsigned long row_cache_misses = 0;
+
+/* sheet index, built once at startup and shared by the redraw helpers.
+   One line offset is kept every sample_interval lines (a power of two);
+   a smaller interval means shorter rescans for rows missing from the row
+   cache. */
+#define SAMPLE_INTERVAL_MIN 8
+#define SAMPLE_INTERVAL_MAX 64
+static size_t sample_interval = SAMPLE_INTERVAL_MAX;
+static const char *sheet_data = NULL;
+static size_t sheet_size = 0;
+static size_t sheet_line_count = 0;
+static size_t *sheet_samples = NULL;
+static size_t sheet_samples_count = 0;
+static size_t sheet_cols = 0;
+static size_t sheet_rows = 0;
+static int sheet_cols_source = VIEWER_COLS_DEFAULT;
+
+/* set at the start of each frame so the first band push waits for vblank */
+static int frame_vblank_pending = 0;
+
+/* Progressive renderer. A frame is drawn band by band: first a coarse pass
+   that decodes every COARSE_STEP-th row and duplicates it, then a fine pass
+   once the view has stopped moving. A new target view abandons a fine pass
+   right away; a coarse pass is always finished so the whole screen follows
+   the view while panning. */
+#define COARSE_STEP 4
+enum { RENDER_DONE, RENDER_COARSE, RENDER_FINE };
+static int render_pass = RENDER_DONE;
+static int render_next_y = 240;
+static int render_view_x = 0, render_view_y = 0;
+static double render_scale = 0.0;
+static int target_view_x = 0, target_view_y = 0;
+static double target_scale = 0.0;
+static int render_bottom_up = 0;
+/* next frame skips the coarse pass and zoom preview, see viewer_jump() */
+static int render_direct = 0;
+/* set when the coarse pass repeats a row instead of drawing it; a coarse
+   pass that never did has drawn the exact frame and needs no fine pass */
+static int render_approximated = 0;
+static unsigned long frames_done = 0;
+
+/* What the display currently shows, row by row: the source row drawn
+   exactly at each screen row (-1 for coarse duplicates and anything else)
+   and the view_x/scale it was drawn at. A vertical pan reads rows that are
+   still valid back with eadk_display_pull_rect() instead of decoding them. */
+static int shown_source_y[240];
+static int shown_view_x = 0;
+static double shown_scale = 0.0;
+static int shown_view_y = 0;
+static unsigned long screen_reuse_hits = 0;
+
+/* Idle-time prefetch of rendered rows just outside the viewport, on the side
+   of the last vertical pan. All entries share one view_x and scale, so they
+   stay valid across vertical pans; pans move in whole sampling quanta (see
+   PAN_QUANTUM in app.c) so the rows they need land exactly on prefetched
+   ones. There are prefetch_rows slots, up to PREFETCH_ROWS, depending on
+   the budget. */
+#define PREFETCH_ROWS 96
+static eadk_color_t *prefetch_pixels = NULL;
+static int prefetch_source_y[PREFETCH_ROWS];
+static int prefetch_rows = 0;
+static int prefetch_lo = INT_MAX, prefetch_hi = INT_MIN;
+static int prefetch_view_x = 0;
+static double prefetch_scale = 0.0;
+static int prefetch_dir_y = 1;
+static int prefetch_next = 0;
+static unsigned long prefetch_hits = 0;
+static unsigned long prefetch_misses = 0;
+static unsigned long rows_decoded = 0;
+static unsigned long bytes_decoded = 0;
+
+/* Whole-sheet overview, filled in during the startup index walk. Pixel
+   (x, y) holds the palette index of source pixel (floor(x * overview_scale),
+   floor(y * overview_scale)), exactly what a render of view (0, 0) at that
+   scale would show, two pixels per byte. */
+static uint8_t *overview = NULL;
+static double overview_scale = 0.0;
+static size_t overview_cols = 0;
+static size_t overview_rows = 0;
+
+/* Memory budget, planned once at startup. The largest heap block we can get
+   is measured, starting from what the calculator model can have at most,
+   and shared out between the band buffer, the line index, the overview, the
+   row cache and the prefetch slots, in that order of priority. */
+#define BUDGET_HEAP_N0110 (192 * 1024)
+#define BUDGET_HEAP_N0120 (768 * 1024)
+#define BUDGET_RESERVE (8 * 1024)
+#define OVERVIEW_BYTES (BUFFER_WIDTH * 240 / 2)
+static uint8_t budget_model = 0;
+static size_t budget_heap = 0;
+static size_t budget_row_cache = 0;
+static int budget_overview = 0;
+
+/* Our encoders end the file with a trailer after the pixel data, which
+   files from older encoders simply don't have:
+     per hotspot: char name[16]; u32 x, y; u16 zoom (in quarters); u16 pad;
+                  u32 row_offsets[240]
+     u16 hotspot count; u16 cols; "CSHS"
+   All integers little-endian. cols is the number of 320-pixel segments per
+   image row, so the layout doesn't have to be guessed. Hotspots are views
+   defined in the encoder; row_offsets[s] is the byte offset of the first
+   line of source row floor(y + s * zoom / 4), 0xFFFFFFFF past the last row,
+   so a jump can index its whole first frame without walking the sheet. */
+#define HOTSPOT_MAX 9
+#define HOTSPOT_NAME_LEN 16
+#define HOTSPOT_RECORD_SIZE (HOTSPOT_NAME_LEN + 12 + 240 * 4)
+#define TRAILER_FOOTER_SIZE 8
+static const char *hotspot_records = NULL;
+static size_t hotspot_count = 0;
+static size_t trailer_cols = 0;
+
+#if VIEWER_DEBUG
+/* Per-stage profile of each frame, from a view change to the end of its fine
+   pass. eadk_timing_millis() is read only at stage boundaries and the time
+   since the last read goes to the stage that was running, so nested stages
+   are not counted twice. The last PROFILE_FRAMES frames are kept in a ring
+   and written to the PROFILE_RECORD storage record as CSV. */
+enum {
+    STAGE_OTHER,
+    STAGE_INDEX,
+    STAGE_OFFSETS,
+    STAGE_DECODE,
+    STAGE_SCALE,
+    STAGE_PUSH,
+    STAGE_COUNT
+};
+static const char *const stage_names[STAGE_COUNT] = {
+    "other", "index", "offsets", "decode", "scale", "push"
+};
+#define PROFILE_FRAMES 32
+#define PROFILE_RECORD "viewer.csv"
+struct frame_profile {
+    uint32_t start_ms;
+    uint32_t stage_ms[STAGE_COUNT];
+    uint32_t bytes_scanned;
+    uint32_t pushes;
+    /* counter values at the start of the frame until it ends, then deltas */
+    uint32_t bytes_decoded;
+    uint32_t rows_decoded;
+    uint32_t rows_reused;
+    uint32_t rows_prefetched;
+    uint32_t offsets_hits;
+    uint32_t offsets_misses;
+};
+static struct frame_profile profile;
+static struct frame_profile profile_ring[PROFILE_FRAMES];
+static unsigned long profile_frames = 0;
+static int profile_active = 0;
+static int profile_stage = STAGE_OTHER;
+static uint64_t profile_clock = 0;
+
+/* Charges the time since the last switch to the running stage and makes
+   stage the running one. Returns the stage it replaced. */
+static int profile_switch(int stage) {
+    uint64_t now = eadk_timing_millis();
+    int previous = profile_stage;
+    profile.stage_ms[previous] += (uint32_t)(now - profile_clock);
+    profile_clock = now;
+    profile_stage = stage;
+    return previous;
+}
+
+static void profile_frame_begin(void) {
+    profile_switch(profile_stage);
+    memset(&profile, 0, sizeof(profile));
+    profile.start_ms = (uint32_t)profile_clock;
+    profile.bytes_decoded = (uint32_t)bytes_decoded;
+    profile.rows_decoded = (uint32_t)rows_decoded;
+    profile.rows_reused = (uint32_t)screen_reuse_hits;
+    profile.rows_prefetched = (uint32_t)prefetch_hits;
+    profile.offsets_hits = (uint32_t)row_cache_hits;
+    profile.offsets_misses = (uint32_t)row_cache_misses;
+    profile_active = 1;
+}
+
+static void profile_frame_end(void) {
+    if (!profile_active) return;
+    profile_switch(profile_stage);
+    profile.bytes_decoded = (uint32_t)bytes_decoded - profile.bytes_decoded;
+    profile.rows_decoded = (uint32_t)rows_decoded - profile.rows_decoded;
+    profile.rows_reused = (uint32_t)screen_reuse_hits - profile.rows_reused;
+    profile.rows_prefetched = (uint32_t)prefetch_hits - profile.rows_prefetched;
+    profile.offsets_hits = (uint32_t)row_cache_hits - profile.offsets_hits;
+    profile.offsets_misses = (uint32_t)row_cache_misses - profile.offsets_misses;
+    profile_ring[profile_frames % PROFILE_FRAMES] = profile;
+    profile_frames++;
+    profile_active = 0;
+}
+
+static const struct frame_profile *profile_last(void) {
+    return profile_frames ? &profile_ring[(profile_frames - 1) % PROFILE_FRAMES] : NULL;
+}
+
+/* Ends the running frame, if any, and saves the ring. */
+void viewer_profile_flush(void) {
+    profile_frame_end();
+    size_t count = profile_frames < PROFILE_FRAMES ? profile_frames : PROFILE_FRAMES;
+    size_t cap = 256 + count * 192;
+    char *text = (char*)malloc(cap);
+    if (!text) return;
+    size_t len = (size_t)snprintf(text, cap, "frame,start_ms,total_ms");
+    for (int s = 0; s < STAGE_COUNT; ++s) {
+        len += (size_t)snprintf(text + len, cap - len, ",%s_ms", stage_names[s]);
+    }
+    len += (size_t)snprintf(text + len, cap - len,
+                            ",bytes_scanned,bytes_decoded,pushes,rows_decoded,rows_reused,"
+                            "rows_prefetched,offsets_hits,offsets_misses\n");
+    for (unsigned long i = profile_frames - count; i < profile_frames; ++i) {
+        const struct frame_profile *f = &profile_ring[i % PROFILE_FRAMES];
+        uint32_t total = 0;
+        for (int s = 0; s < STAGE_COUNT; ++s) total += f->stage_ms[s];
+        len += (size_t)snprintf(text + len, cap - len, "%lu,%lu,%lu", i,
+                                (unsigned long)f->start_ms, (unsigned long)total);
+        for (int s = 0; s < STAGE_COUNT; ++s) {
+            len += (size_t)snprintf(text + len, cap - len, ",%lu", (unsigned long)f->stage_ms[s]);
+        }
+        len += (size_t)snprintf(text + len, cap - len, ",%lu,%lu,%lu,%lu,%lu,%lu,%lu,%lu\n",
+                                (unsigned long)f->bytes_scanned, (unsigned long)f->bytes_decoded,
+                                (unsigned long)f->pushes, (unsigned long)f->rows_decoded,
+                                (unsigned long)f->rows_reused, (unsigned long)f->rows_prefetched,
+                                (unsigned long)f->offsets_hits, (unsigned long)f->offsets_misses);
+    }
+    extapp_fileWrite(PROFILE_RECORD, text, len);
+    free(text);
+}
+
+#define PROFILE_ENTER(stage) int profile_previous = profile_switch(stage)
+#define PROFILE_LEAVE() profile_switch(profile_previous)
+#define PROFILE_ADD(field, n) (profile.field += (uint32_t)(n))
+#else
+#define PROFILE_ENTER(stage) ((void)0)
+#define PROFILE_LEAVE() ((void)0)
+#define PROFILE_ADD(field, n) ((void)0)
+#endif
+
+static size_t budget_measure(void) {
+#ifdef SIMULATOR
+    budget_model = 0;
+#else
+    budget_model = extapp_calculatorModel();
+#endif
+    size_t size = (budget_model == 2) ? BUDGET_HEAP_N0120 : BUDGET_HEAP_N0110;
+    while (size >= 4096) {
+        void *p = malloc(size);
+        if (p) {
+            free(p);
+            return size;
+        }
+        size -= size / 8;
+    }
+    return 0;
+}
+
+/* Plans the budget for a sheet of line_count lines and allocates the band
+   buffer and the prefetch slots. The index, the overview and the row cache
+   are allocated with the sizes chosen here when they are built. Returns 0
+   if not even the smallest band fits. */
+static int budget_plan(size_t line_count) {
+    static const int band_heights[] = { 40, 24, 20, 12, 8 };
+    budget_heap = budget_measure();
+    size_t avail = (budget_heap > BUDGET_RESERVE) ? budget_heap - BUDGET_RESERVE : 0;
+
+    size_t n = 0;
+    while (n + 1 < sizeof(band_heights) / sizeof(band_heights[0]) &&
+           (size_t)band_heights[n] * BUFFER_WIDTH * sizeof(eadk_color_t) > avail / 5) {
+        n++;
+    }
+    for (; n < sizeof(band_heights) / sizeof(band_heights[0]); ++n) {
+        line_buffer = (eadk_color_t*)malloc((size_t)band_heights[n] * BUFFER_WIDTH * sizeof(eadk_color_t));
+        if (line_buffer) break;
+    }
+    if (!line_buffer) return 0;
+    band_height = band_heights[n];
+    size_t used = (size_t)band_height * BUFFER_WIDTH * sizeof(eadk_color_t);
+    avail = (avail > used) ? avail - used : 0;
+
+    /* the index gets an eighth at most; past SAMPLE_INTERVAL_MAX it only
+       grows sparser if it would take half of what is left */
+    sample_interval = SAMPLE_INTERVAL_MIN;
+    while (sample_interval < SAMPLE_INTERVAL_MAX &&
+           (line_count / sample_interval + 1) * sizeof(size_t) > avail / 8) {
+        sample_interval *= 2;
+    }
+    while ((line_count / sample_interval + 1) * sizeof(size_t) > avail / 2 && sample_interval < line_count) {
+        sample_interval *= 2;
+    }
+    used = (line_count / sample_interval + 1) * sizeof(size_t);
+    avail = (avail > used) ? avail - used : 0;
+
+    budget_overview = avail >= OVERVIEW_BYTES + 16 * 1024;
+    if (budget_overview) avail -= OVERVIEW_BYTES;
+
+    budget_row_cache = avail / 2;
+    avail -= budget_row_cache;
+
+    prefetch_rows = (int)(avail / 2 / (BUFFER_WIDTH * sizeof(eadk_color_t)));
+    if (prefetch_rows > PREFETCH_ROWS) prefetch_rows = PREFETCH_ROWS;
+    prefetch_rows -= prefetch_rows % COARSE_STEP;
+    while (prefetch_rows > 0) {
+        prefetch_pixels = (eadk_color_t*)malloc((size_t)prefetch_rows * BUFFER_WIDTH * sizeof(eadk_color_t));
+        if (prefetch_pixels) break;
+        prefetch_rows /= 2;
+        prefetch_rows -= prefetch_rows % COARSE_STEP;
+    }
+    return 1;
+}
+
+static void row_cache_init(size_t cols) {
+    size_t slot_bytes = (cols + 1) * sizeof(size_t);
+    size_t slots = ROW_CACHE_MIN;
+    while (slots < ROW_CACHE_MAX && 2 * slots * slot_bytes <= budget_row_cache) slots *= 2;
+    /* halve the cache until it fits the heap that is really left */
+    for (; slots > 1; slots /= 2) {
+        row_cache_keys = (size_t*)malloc(slots * sizeof(size_t));
+        row_cache_offsets = (size_t*)malloc(slots * cols * sizeof(size_t));
+        if (row_cache_keys && row_cache_offsets) break;
+        free(row_cache_keys);
+        free(row_cache_offsets);
+        row_cache_keys = row_cache_offsets = NULL;
+    }
+    if (!row_cache_keys) return;
+    row_cache_size = slots;
+    for (row_cache_bits = 0; ((size_t)1 << row_cache_bits) < slots; ++row_cache_bits) {}
+    for (size_t i = 0; i < row_cache_size; ++i) row_cache_keys[i] = SIZE_MAX;
+}
+
+static int row_cache_get(size_t source_y, size_t *out_offsets, size_t cols) {
+    if (!row_cache_size || row_cache_keys[ROW_CACHE_SLOT(source_y)] != source_y) {
+        row_cache_misses++;
+        return 0;
+    }
+    memcpy(out_offsets, &row_cache_offsets[ROW_CACHE_SLOT(source_y) * cols], cols * sizeof(size_t));
+    row_cache_hits++;
+    return 1;
+}
+
+static void row_cache_put(size_t source_y, const size_t *offsets, size_t cols) {
+    if (!row_cache_size) return;
+    size_t idx = ROW_CACHE_SLOT(source_y);
+    row_cache_keys[idx] = source_y;
+    memcpy(&row_cache_offsets[idx * cols], offsets, cols * sizeof(size_t));
+}
+
+static void flush_line_buffer(void) {
+    if (buffer_line_count == 0) return;
+    PROFILE_ENTER(STAGE_PUSH);
+    if (frame_vblank_pending) {
+        eadk_display_wait_for_vblank();
+        frame_vblank_pending = 0;
+    }
+    eadk_display_push_rect(
+        (eadk_rect_t){0, (uint16_t)buffer_y_start, BUFFER_WIDTH, (uint16_t)buffer_line_count},
+        line_buffer
+    );
+    buffer_line_count = 0;
+    PROFILE_ADD(pushes, 1);
+    PROFILE_LEAVE();
+}
+
+static void build_source_y_lookup(int view_y, double scale, int rows) {
+    for (int screen_y = 0; screen_y < 240; ++screen_y) {
+        source_y_lookup[screen_y] = (int)floor(view_y + screen_y * scale);
+    }
+    source_y_lookup_valid = 1;
+}
+
+
+static size_t line_bytes(const char* d, size_t sz, size_t off) {
+    if (off >= sz) return 0;
+    size_t i = off;
+    uint32_t pixels = 0;
+    while (pixels < 320 && i < sz) {
+        uint8_t b = (uint8_t)d[i++];
+        uint32_t run = ((b >> 4) & 0x0F) + 1;
+        pixels += run;
+    }
+    PROFILE_ADD(bytes_scanned, i - off);
+    return (pixels >= 320) ? (i - off) : 0;
+}
+
+static size_t get_offset_for_index(const char *data_local, size_t data_sz, size_t target_idx,
+                                   size_t line_cnt, size_t sample_interval,
+                                   const size_t *samples_local, size_t samples_cnt) {
+    if (target_idx >= line_cnt) return SIZE_MAX;
+    size_t sample_i = target_idx / sample_interval;
+    if (sample_i >= samples_cnt) sample_i = samples_cnt ? samples_cnt - 1 : 0;
+    size_t offi = samples_local[sample_i];
+    size_t cur = sample_i * sample_interval;
+    while (cur < target_idx && offi < data_sz) {
+        size_t lb = line_bytes(data_local, data_sz, offi);
+        if (lb == 0) return SIZE_MAX;
+        offi += lb;
+        cur++;
+    }
+    return offi;
+}
+
+static int populate_col_offsets(const char *data_local, size_t data_sz,
+                                size_t *col_offsets, size_t cols, size_t source_y,
+                                size_t line_cnt, size_t sample_interval,
+                                const size_t *samples_local, size_t samples_cnt) {
+    size_t idx_start = (size_t)source_y * cols;
+    if (idx_start >= line_cnt) {
+        for (size_t c = 0; c < cols; ++c) col_offsets[c] = SIZE_MAX;
+        return 0;
+    }
+
+    size_t sample_i = idx_start / sample_interval;
+    if (sample_i >= samples_cnt) sample_i = samples_cnt ? samples_cnt - 1 : 0;
+    size_t off = samples_local[sample_i];
+    size_t cur = sample_i * sample_interval;
+
+    /* If we have a recent scan hint and it's closer, start from it */
+    if (scan_hint_valid && scan_hint_idx <= idx_start && scan_hint_idx >= sample_i * sample_interval) {
+        off = scan_hint_off;
+        cur = scan_hint_idx;
+    }
+
+    /* advance to idx_start */
+    while (cur < idx_start && off < data_sz) {
+        size_t lb = line_bytes(data_local, data_sz, off);
+        if (lb == 0) return -1;
+        off += lb;
+        cur++;
+    }
+
+    /* fill offsets for this row sequentially */
+    for (size_t c = 0; c < cols; ++c) {
+        size_t idx = idx_start + c;
+        if (idx >= line_cnt) { col_offsets[c] = SIZE_MAX; continue; }
+        if (off >= data_sz) { col_offsets[c] = SIZE_MAX; continue; }
+        col_offsets[c] = off;
+        size_t lb = line_bytes(data_local, data_sz, off);
+        if (lb == 0) { /* mark remaining as missing */
+            for (size_t cc = c + 1; cc < cols; ++cc) col_offsets[cc] = SIZE_MAX;
+            return -1;
+        }
+        off += lb;
+    }
+    /* update scan hint to the position after the last filled line */
+    scan_hint_idx = idx_start + cols;
+    scan_hint_off = off;
+    return 0;
+}
+
+static void overview_set(int x, int y, uint8_t index) {
+    uint8_t *p = &overview[(y * BUFFER_WIDTH + x) >> 1];
+    *p = (x & 1) ? ((*p & 0xF0) | index) : ((*p & 0x0F) | (uint8_t)(index << 4));
+}
+
+static int overview_begin(size_t cols, size_t rows) {
+    if (!overview && budget_overview) overview = (uint8_t*)malloc(OVERVIEW_BYTES);
+    if (!overview) return 0;
+    memset(overview, 0xFF, OVERVIEW_BYTES);
+    overview_cols = cols;
+    overview_rows = rows;
+    overview_scale = (double)(cols * 320) / 320.0;
+    if ((double)rows / 240.0 > overview_scale) overview_scale = (double)rows / 240.0;
+    if (overview_scale < 1.0) overview_scale = 1.0;
+    return 1;
+}
+
+/* Samples line line_idx, starting at off, into the overview if its source
+   row is one of the overview rows. Called once per line while indexing. */
+static void overview_add_line(const char *data, size_t data_size, size_t off, size_t line_idx) {
+    if (!overview_cols) return;
+    size_t source_y = line_idx / overview_cols;
+    if (source_y >= overview_rows) return;
+    int y = (int)ceil((double)source_y / overview_scale);
+    if (y >= 240 || (size_t)floor(y * overview_scale) != source_y) return;
+
+    int line_x = (int)((line_idx % overview_cols) * 320);
+    int x = (int)ceil(line_x / overview_scale);
+    int src_x = (int)floor(x * overview_scale);
+    int pixel = line_x;
+    while (x < BUFFER_WIDTH && src_x < line_x + 320 && off < data_size) {
+        uint8_t b = (uint8_t)data[off++];
+        int run_end = pixel + ((b >> 4) & 0x0F) + 1;
+        while (src_x < run_end && x < BUFFER_WIDTH) {
+            overview_set(x, y, b & 0x0F);
+            x++;
+            src_x = (int)floor(x * overview_scale);
+        }
+        pixel = run_end;
+    }
+}
+
+static void overview_build(const char *data, size_t data_size, size_t line_cnt, size_t cols) {
+    if (!overview_begin(cols, line_cnt / cols)) return;
+    size_t off = 0;
+    for (size_t li = 0; li < line_cnt; ++li) {
+        size_t lb = line_bytes(data, data_size, off);
+        if (lb == 0) break;
+        overview_add_line(data, data_size, off, li);
+        off += lb;
+    }
+}
+
+/* Offsets of every column segment of source_y, from the row cache or the
+   index. The returned array is reused by the next call. */
+static const size_t *source_row_offsets(int source_y) {
+    PROFILE_ENTER(STAGE_OFFSETS);
+    if (!row_cache_get((size_t)source_y, row_offsets, sheet_cols)) {
+        if (populate_col_offsets(sheet_data, sheet_size, row_offsets, sheet_cols, (size_t)source_y, sheet_line_count, sample_interval, sheet_samples, sheet_samples_count) < 0) {
+            /* fallback: fill with per-index lookups */
+            for (size_t c = 0; c < sheet_cols; ++c) {
+                size_t idx = (size_t)source_y * sheet_cols + c;
+                row_offsets[c] = (idx < sheet_line_count) ? get_offset_for_index(sheet_data, sheet_size, idx, sheet_line_count, sample_interval, sheet_samples, sheet_samples_count) : SIZE_MAX;
+            }
+        }
+        row_cache_put((size_t)source_y, row_offsets, sheet_cols);
+    }
+    PROFILE_LEAVE();
+    return row_offsets;
+}
+
+/* Samples one source row straight from the RLE stream into a screen row.
+   Only the column segments that screen pixels land in are decoded, and runs
+   are walked without expanding them, so the cost depends on the view and
+   not on the sheet width. The web editor's device view draws with a port of
+   it (docs/device.js); python/check_device.py compares the two. */
+static void render_source_row(const size_t *offsets, eadk_color_t *row_ptr, int view_x, double scale) {
+    PROFILE_ENTER(STAGE_DECODE);
+    if (scale == 1.0 && view_x >= 0) {
+        /* 1:1 the screen row is one contiguous span of each segment */
+        for (int screen_x = 0; screen_x < BUFFER_WIDTH;) {
+            int src_x = view_x + screen_x;
+            size_t c = (size_t)(src_x / 320);
+            int w = 320 - src_x % 320;
+            if (w > BUFFER_WIDTH - screen_x) w = BUFFER_WIDTH - screen_x;
+            size_t off = c < sheet_cols ? offsets[c] : SIZE_MAX;
+            size_t end = rle_decode_span((const uint8_t *)sheet_data, sheet_size, off,
+                                         src_x % 320, w, grayscale_palette, row_ptr + screen_x);
+            if (off < end) bytes_decoded += end - off;
+            screen_x += w;
+        }
+        PROFILE_LEAVE();
+        return;
+    }
+    int screen_x = 0;
+    int src_x = view_x;
+    while (screen_x < BUFFER_WIDTH) {
+        size_t c = (size_t)(src_x / 320);
+        if (src_x < 0 || c >= sheet_cols) {
+            row_ptr[screen_x++] = eadk_color_white;
+            src_x = (int)floor((double)screen_x * scale + view_x);
+            continue;
+        }
+        int line_end = (int)(c + 1) * 320;
+        int pixel = (int)c * 320;
+        size_t i = offsets[c];
+        while (i < sheet_size && screen_x < BUFFER_WIDTH && src_x < line_end) {
+            uint8_t b = (uint8_t)sheet_data[i++];
+            int run_end = pixel + ((b >> 4) & 0x0F) + 1;
+            eadk_color_t color = grayscale_palette[b & 0x0F];
+            while (src_x < run_end && src_x < line_end && screen_x < BUFFER_WIDTH) {
+                row_ptr[screen_x++] = color;
+                src_x = (int)floor((double)screen_x * scale + view_x);
+            }
+            pixel = run_end;
+        }
+        if (offsets[c] < i) bytes_decoded += i - offsets[c];
+        /* missing line or stream ended before filling 320 pixels: pad with white */
+        while (src_x < line_end && screen_x < BUFFER_WIDTH) {
+            row_ptr[screen_x++] = eadk_color_white;
+            src_x = (int)floor((double)screen_x * scale + view_x);
+        }
+    }
+    PROFILE_LEAVE();
+}
+
+static void prefetch_reset(void) {
+    for (int j = 0; j < prefetch_rows; ++j) prefetch_source_y[j] = -1;
+    prefetch_lo = INT_MAX;
+    prefetch_hi = INT_MIN;
+}
+
+static int prefetch_lookup(int source_y, eadk_color_t *row_ptr) {
+    if (source_y < prefetch_lo || source_y > prefetch_hi ||
+        prefetch_view_x != render_view_x || prefetch_scale != render_scale) {
+        prefetch_misses++;
+        return 0;
+    }
+    for (int j = 0; j < prefetch_rows; ++j) {
+        if (prefetch_source_y[j] == source_y) {
+            memcpy(row_ptr, &prefetch_pixels[j * BUFFER_WIDTH], BUFFER_WIDTH * sizeof(eadk_color_t));
+            prefetch_hits++;
+            return 1;
+        }
+    }
+    prefetch_misses++;
+    return 0;
+}
+
+void viewer_prefetch_direction(int dir_y) {
+    prefetch_dir_y = dir_y;
+}
+
+/* Prepares one row for the next pan. Rows past the viewport edge are
+   rendered into the prefetch slots, those that will fall on the coarse grid
+   first; afterwards the offsets of every visible row are indexed so a
+   horizontal pan only has to decode. Returns 0 when there is nothing left. */
+int viewer_prefetch_step(void) {
+    if (prefetch_next == 0 && (prefetch_view_x != render_view_x || prefetch_scale != render_scale)) {
+        prefetch_reset();
+        prefetch_view_x = render_view_x;
+        prefetch_scale = render_scale;
+    }
+    if (prefetch_next < 2 * prefetch_rows) {
+        int coarse_phase = prefetch_next < prefetch_rows;
+        int j = prefetch_next % prefetch_rows;
+        prefetch_next++;
+        int screen_y = (prefetch_dir_y > 0) ? 240 + j : -1 - j;
+        if (((screen_y % COARSE_STEP) == 0) != coarse_phase) return 1;
+        int source_y = (int)floor(render_view_y + screen_y * render_scale);
+        if (source_y < 0 || source_y >= (int)sheet_rows) return 1;
+        render_source_row(source_row_offsets(source_y), &prefetch_pixels[j * BUFFER_WIDTH], render_view_x, render_scale);
+        prefetch_source_y[j] = source_y;
+        if (source_y < prefetch_lo) prefetch_lo = source_y;
+        if (source_y > prefetch_hi) prefetch_hi = source_y;
+        return 1;
+    }
+    int screen_y = prefetch_next - 2 * prefetch_rows;
+    if (screen_y >= 240) return 0;
+    prefetch_next++;
+    int source_y = source_y_lookup[screen_y];
+    if (source_y < 0 || source_y >= (int)sheet_rows) return 1;
+    source_row_offsets(source_y);
+    return 1;
+}
+
+static void shown_invalidate(void) {
+    for (int i = 0; i < 240; ++i) shown_source_y[i] = -1;
+}
+
+static int screen_lookup(int screen_y, int source_y, eadk_color_t *row_ptr) {
+    if (shown_view_x != render_view_x || shown_scale != render_scale) return 0;
+    double shift = (render_view_y - shown_view_y) / render_scale;
+    int old_y = screen_y + (int)floor(shift + 0.5);
+    if (old_y < 0 || old_y >= 240 || shown_source_y[old_y] != source_y) return 0;
+    eadk_display_pull_rect((eadk_rect_t){0, (uint16_t)old_y, BUFFER_WIDTH, 1}, row_ptr);
+    screen_reuse_hits++;
+    return 1;
+}
+
+static void render_band(int y0, int step) {
+    int y1 = y0 + band_height;
+    if (y1 > 240) y1 = 240;
+    int band_source_y[BUFFER_HEIGHT];
+    /* Rows that are already exact on screen or prefetched are always taken
+       as is; in a coarse pass the remaining off-grid rows repeat the row
+       above instead of being decoded. */
+    for (int screen_y = y0; screen_y < y1; ++screen_y) {
+        eadk_color_t *row_ptr = &line_buffer[(screen_y - y0) * BUFFER_WIDTH];
+        int source_y = source_y_lookup[screen_y];
+        if (source_y < 0 || source_y >= (int)sheet_rows) {
+            for (int i = 0; i < BUFFER_WIDTH; ++i) row_ptr[i] = eadk_color_white;
+            source_y = -1;
+        } else if (screen_lookup(screen_y, source_y, row_ptr) || prefetch_lookup(source_y, row_ptr)) {
+            /* exact row without decoding */
+        } else if ((screen_y - y0) % step != 0) {
+            memcpy(row_ptr, row_ptr - BUFFER_WIDTH, BUFFER_WIDTH * sizeof(eadk_color_t));
+            source_y = -1;
+            render_approximated = 1;
+        } else {
+            render_source_row(source_row_offsets(source_y), row_ptr, render_view_x, render_scale);
+            rows_decoded++;
+        }
+        band_source_y[screen_y - y0] = source_y;
+    }
+    buffer_y_start = y0;
+    buffer_line_count = y1 - y0;
+    flush_line_buffer();
+    for (int screen_y = y0; screen_y < y1; ++screen_y) shown_source_y[screen_y] = band_source_y[screen_y - y0];
+}
+
+/* Resamples the frame on screen, drawn at (old_x, old_y, old_scale), to the
+   current render view straight from the display, so a zoom step shows up
+   at once and the fine pass then replaces it with decoded rows. Bands are
+   pushed in an order that keeps the rows they read from being overwritten
+   first; a row whose source is already gone is left white. */
+static void zoom_preview(int old_x, int old_y, double old_scale) {
+    PROFILE_ENTER(STAGE_SCALE);
+    const int band_count = 240 / band_height;
+    int map_x[BUFFER_WIDTH];
+    int map_y[240];
+    eadk_color_t old_row[BUFFER_WIDTH];
+    for (int x = 0; x < BUFFER_WIDTH; ++x) {
+        map_x[x] = (int)floor((render_view_x + x * render_scale - old_x) / old_scale);
+        if (map_x[x] >= BUFFER_WIDTH) map_x[x] = -1;
+    }
+    for (int y = 0; y < 240; ++y) {
+        map_y[y] = (int)floor((render_view_y + y * render_scale - old_y) / old_scale);
+        if (map_y[y] >= 240) map_y[y] = -1;
+    }
+
+    int pushed = 0;
+    frame_vblank_pending = 1;
+    for (int n = 0; n < band_count; ++n) {
+        int band = -1;
+        for (int b = 0; b < band_count && band < 0; ++b) {
+            if (pushed & (1 << b)) continue;
+            int clobbered = 0;
+            for (int y = b * band_height; y < (b + 1) * band_height && !clobbered; ++y) {
+                if (map_y[y] >= 0 && (pushed & (1 << (map_y[y] / band_height)))) clobbered = 1;
+            }
+            if (!clobbered) band = b;
+        }
+        for (int b = 0; b < band_count && band < 0; ++b) {
+            if (!(pushed & (1 << b))) band = b;
+        }
+
+        int y0 = band * band_height;
+        int pulled_y = -1;
+        for (int y = y0; y < y0 + band_height; ++y) {
+            eadk_color_t *row_ptr = &line_buffer[(y - y0) * BUFFER_WIDTH];
+            int oy = map_y[y];
+            if (oy < 0 || (pushed & (1 << (oy / band_height)))) {
+                for (int x = 0; x < BUFFER_WIDTH; ++x) row_ptr[x] = eadk_color_white;
+                continue;
+            }
+            if (oy != pulled_y) {
+                eadk_display_pull_rect((eadk_rect_t){0, (uint16_t)oy, BUFFER_WIDTH, 1}, old_row);
+                pulled_y = oy;
+            }
+            for (int x = 0; x < BUFFER_WIDTH; ++x) {
+                row_ptr[x] = (map_x[x] >= 0) ? old_row[map_x[x]] : eadk_color_white;
+            }
+        }
+        buffer_y_start = y0;
+        buffer_line_count = band_height;
+        flush_line_buffer();
+        pushed |= 1 << band;
+    }
+    PROFILE_LEAVE();
+}
+
+void viewer_overview_draw(void) {
+    frame_vblank_pending = 1;
+    for (int y0 = 0; y0 < 240; y0 += band_height) {
+        for (int y = y0; y < y0 + band_height; ++y) {
+            const uint8_t *src = &overview[y * BUFFER_WIDTH / 2];
+            eadk_color_t *row_ptr = &line_buffer[(y - y0) * BUFFER_WIDTH];
+            for (int x = 0; x < BUFFER_WIDTH; x += 2) {
+                row_ptr[x] = grayscale_palette[src[x >> 1] >> 4];
+                row_ptr[x + 1] = grayscale_palette[src[x >> 1] & 0x0F];
+            }
+        }
+        buffer_y_start = y0;
+        buffer_line_count = band_height;
+        flush_line_buffer();
+    }
+}
+
+/* 0.0 when there is no overview: it didn't fit the budget or the layout
+   was only found out after the index walk. */
+double viewer_overview_scale(void) {
+    return overview ? overview_scale : 0.0;
+}
+
+/* Declares the overview on screen to be the rendered frame of view (0, 0)
+   at overview_scale, so the renderer resamples or reuses it like any other
+   frame. */
+void viewer_overview_as_frame(void) {
+    render_view_x = render_view_y = 0;
+    render_scale = overview_scale;
+    target_view_x = target_view_y = 0;
+    target_scale = overview_scale;
+    build_source_y_lookup(0, overview_scale, sheet_rows);
+    render_pass = RENDER_DONE;
+    render_next_y = 240;
+    prefetch_next = 0;
+    shown_view_x = shown_view_y = 0;
+    shown_scale = overview_scale;
+    for (int y = 0; y < 240; ++y) {
+        int source_y = source_y_lookup[y];
+        shown_source_y[y] = (source_y < (int)sheet_rows) ? source_y : -1;
+    }
+}
+
+static uint32_t read_le(const char *p, int bytes) {
+    uint32_t v = 0;
+    for (int i = bytes - 1; i >= 0; --i) v = (v << 8) | (uint8_t)p[i];
+    return v;
+}
+
+/* Looks for a trailer at the end of the file and returns the size of the
+   pixel data in front of it. */
+static size_t trailer_load(const char *data, size_t data_size) {
+    if (data_size < TRAILER_FOOTER_SIZE) return data_size;
+    const char *footer = data + data_size - TRAILER_FOOTER_SIZE;
+    if (memcmp(footer + 4, "CSHS", 4) != 0) return data_size;
+    size_t count = read_le(footer, 2);
+    size_t trailer = count * HOTSPOT_RECORD_SIZE + TRAILER_FOOTER_SIZE;
+    if (count > HOTSPOT_MAX || trailer > data_size) return data_size;
+    hotspot_records = footer - count * HOTSPOT_RECORD_SIZE;
+    hotspot_count = count;
+    trailer_cols = read_le(footer + 2, 2);
+    return data_size - trailer;
+}
+
+size_t viewer_hotspot_count(void) {
+    return hotspot_count;
+}
+
+void viewer_hotspot_view(size_t h, int *view_x, int *view_y, double *scale) {
+    const char *rec = hotspot_records + h * HOTSPOT_RECORD_SIZE + HOTSPOT_NAME_LEN;
+    *view_x = (int)read_le(rec, 4);
+    *view_y = (int)read_le(rec + 4, 4);
+    *scale = read_le(rec + 8, 2) / 4.0;
+}
+
+/* Fills the row offset cache for the first frame of hotspot h from its
+   stored offsets, for a view at view_y and scale. Row offsets do not depend
+   on x, so this is only skipped when the view was clamped vertically or the
+   scale changed on the way, as then the stored rows are not the ones that
+   will be drawn. */
+void viewer_hotspot_seed(size_t h, int view_y, double scale) {
+    int hx, hy;
+    double hs;
+    viewer_hotspot_view(h, &hx, &hy, &hs);
+    if (trailer_cols != sheet_cols || hy != view_y || hs != scale) return;
+    const char *offsets = hotspot_records + h * HOTSPOT_RECORD_SIZE + HOTSPOT_NAME_LEN + 12;
+    for (int s = 0; s < 240; ++s) {
+        int source_y = (int)floor(view_y + s * scale);
+        uint32_t off = read_le(offsets + s * 4, 4);
+        if (off == 0xFFFFFFFFu || off >= sheet_size || source_y >= (int)sheet_rows) break;
+        if (row_cache_get((size_t)source_y, row_offsets, sheet_cols)) continue;
+        scan_hint_idx = (size_t)source_y * sheet_cols;
+        scan_hint_off = off;
+        scan_hint_valid = 1;
+        if (populate_col_offsets(sheet_data, sheet_size, row_offsets, sheet_cols, (size_t)source_y, sheet_line_count, sample_interval, sheet_samples, sheet_samples_count) == 0) {
+            row_cache_put((size_t)source_y, row_offsets, sheet_cols);
+        }
+    }
+}
+
+void viewer_set_view(int view_x, int view_y, double scale) {
+    target_view_x = view_x;
+    target_view_y = view_y;
+    target_scale = scale;
+}
+
+/* Like viewer_set_view(), but the new view is drawn in one fine pass: a jump
+   lands on rows that are not on screen, so neither the coarse pass nor the
+   zoom preview has anything useful to show first. */
+void viewer_jump(int view_x, int view_y, double scale) {
+    viewer_set_view(view_x, view_y, scale);
+    render_direct = 1;
+}
+
+#if VIEWER_DEBUG
+/* Redraws the current view in one fine pass, e.g. once the HUD is hidden. */
+void viewer_refresh(void) {
+    render_view_x = INT_MIN;
+    viewer_jump(target_view_x, target_view_y, target_scale);
+}
+#endif
+
+/* Draws at most one band. Returns 0 once the target view is fully refined. */
+int viewer_render_step(void) {
+    int stale = target_view_x != render_view_x || target_view_y != render_view_y ||
+                target_scale != render_scale;
+    if (stale && (render_pass != RENDER_COARSE || render_next_y >= 240)) {
+        int rescaled = render_scale != 0.0 && target_scale != render_scale;
+        /* rows still on screen keep the previous geometry until overwritten */
+        shown_view_x = render_view_x;
+        shown_view_y = render_view_y;
+        shown_scale = render_scale;
+        /* when the content moves down, walk bands bottom-up so rows are
+           pulled back before the bands above overwrite them */
+        render_bottom_up = target_view_y < render_view_y;
+#if VIEWER_DEBUG
+        /* a frame cut short by the next view change is still recorded */
+        profile_frame_end();
+        profile_frame_begin();
+#endif
+        render_view_x = target_view_x;
+        render_view_y = target_view_y;
+        render_scale = target_scale;
+        build_source_y_lookup(render_view_y, render_scale, sheet_rows);
+        render_pass = RENDER_COARSE;
+        render_approximated = 0;
+        render_next_y = 0;
+        frame_vblank_pending = 1;
+        prefetch_next = 0;
+        if (render_direct) {
+            render_direct = 0;
+            shown_invalidate();
+            shown_view_x = render_view_x;
+            shown_view_y = render_view_y;
+            shown_scale = render_scale;
+            render_pass = RENDER_FINE;
+            return viewer_render_step();
+        }
+        if (rescaled) {
+            /* the resampled frame stands in for the coarse pass */
+            zoom_preview(shown_view_x, shown_view_y, shown_scale);
+            shown_invalidate();
+            shown_view_x = render_view_x;
+            shown_view_y = render_view_y;
+            shown_scale = render_scale;
+            render_pass = RENDER_FINE;
+            frame_vblank_pending = 1;
+            return 1;
+        }
+    }
+    if (render_next_y >= 240) {
+        if (render_pass == RENDER_COARSE && !render_approximated) {
+            /* every row was reused, prefetched or decoded: the frame is done */
+            shown_view_x = render_view_x;
+            shown_view_y = render_view_y;
+            shown_scale = render_scale;
+            render_pass = RENDER_FINE;
+        }
+        if (render_pass != RENDER_COARSE) {
+            if (render_pass != RENDER_DONE) frames_done++;
+            render_pass = RENDER_DONE;
+#if VIEWER_DEBUG
+            profile_frame_end();
+#endif
+            return 0;
+        }
+        render_pass = RENDER_FINE;
+        render_next_y = 0;
+        frame_vblank_pending = 1;
+        shown_view_x = render_view_x;
+        shown_view_y = render_view_y;
+        shown_scale = render_scale;
+    }
+    int y0 = render_bottom_up ? 240 - band_height - render_next_y : render_next_y;
+    render_band(y0, render_pass == RENDER_COARSE ? COARSE_STEP : 1);
+    render_next_y += band_height;
+    return 1;
+}
+
+static size_t square_cols(size_t line_count) {
+    double sqv = (double)line_count / 240.0;
+    if (sqv > 0.0) {
+        size_t sc = (size_t)(sqrt(sqv) + 0.5);
+        if (sc >= 1 && (size_t)sc * (size_t)sc * 240ULL == line_count) {
+            return sc;
+        }
+    }
+    return 0;
+}
+
+/* Number of pixels that differ between the lines starting at off_a and
+   off_b, walking both run streams side by side. */
+static uint32_t line_diff(const char *data_local, size_t data_sz, size_t off_a, size_t off_b) {
+    uint32_t pos = 0, end_a = 0, end_b = 0, diff = 0;
+    uint8_t index_a = 0, index_b = 0;
+    while (pos < 320) {
+        if (pos >= end_a) {
+            if (off_a >= data_sz) break;
+            uint8_t b = (uint8_t)data_local[off_a++];
+            end_a += ((b >> 4) & 0x0F) + 1;
+            index_a = b & 0x0F;
+        }
+        if (pos >= end_b) {
+            if (off_b >= data_sz) break;
+            uint8_t b = (uint8_t)data_local[off_b++];
+            end_b += ((b >> 4) & 0x0F) + 1;
+            index_b = b & 0x0F;
+        }
+        uint32_t next = end_a < end_b ? end_a : end_b;
+        if (next > 320) next = 320;
+        if (index_a != index_b) diff += next - pos;
+        pos = next;
+    }
+    return diff + (320 - pos);
+}
+
+/* Guesses the layout of files that don't record it. Line i and line
+   i + cols are vertically adjacent pixel rows, which look much more alike
+   than lines further apart, so the layout is the one where they differ in
+   the fewest pixels, probed at evenly spread index samples. Ties, as in a
+   blank sheet, go to the layout closest to square. */
+static size_t guess_cols(const char *data_local, size_t data_sz, size_t line_cnt,
+                         const size_t *samples_local, size_t samples_cnt) {
+    size_t probe_step = samples_cnt / 32 + 1;
+    size_t best = 0;
+    double best_score = 0.0, best_squareness = 0.0;
+    for (size_t c = 1; c * 240 <= line_cnt; ++c) {
+        if (line_cnt % c != 0 || (line_cnt / c) % 240 != 0) continue;
+        uint64_t diff = 0, total = 0;
+        for (size_t k = 0; k < samples_cnt; k += probe_step) {
+            if (k * sample_interval + c >= line_cnt) break;
+            size_t off = samples_local[k];
+            size_t lb = line_bytes(data_local, data_sz, off);
+            size_t next = off;
+            for (size_t n = 0; n < c && lb; ++n) {
+                next += lb;
+                lb = line_bytes(data_local, data_sz, next);
+            }
+            if (!lb) break;
+            diff += line_diff(data_local, data_sz, off, next);
+            total += 320;
+        }
+        double score = (double)diff / (double)(total + 1);
+        double squareness = fabs(log((double)c * 240.0 / (double)(line_cnt / c)));
+        if (!best || score < best_score - 1e-9 ||
+            (score <= best_score + 1e-9 && squareness < best_squareness)) {
+            best = c;
+            best_score = score;
+            best_squareness = squareness;
+        }
+    }
+    return best;
+}
+
+/* Startup work: counting the pixels, indexing the lines, settling the
+   layout, then resolving the offsets of every row of the first frame and
+   decoding its top rows into the prefetch slots. It runs in slices so the
+   cover screen can do it while it waits for keys; main() finishes whatever
+   is left once the viewer is unlocked. */
+#define PREPARE_COUNT_CHUNK 4096
+#define PREPARE_INDEX_CHUNK 64
+enum {
+    PREPARE_START, PREPARE_COUNT, PREPARE_PLAN, PREPARE_INDEX, PREPARE_LAYOUT,
+    PREPARE_WARM_OFFSETS, PREPARE_WARM_ROWS, PREPARE_DONE, PREPARE_EMPTY, PREPARE_FAILED
+};
+static int prepare_stage = PREPARE_START;
+static size_t prepare_off = 0;
+static size_t prepare_line = 0;
+static int prepare_row = 0;
+static size_t prepare_total_pixels = 0;
+static size_t prepare_expected_lines = 0;
+static size_t prepare_sample_slots = 0;
+static size_t prepare_sample_idx = 0;
+
+/* Does one bounded unit of startup work. Returns 0 once there is nothing left. */
+static int prepare_work(void) {
+    switch (prepare_stage) {
+    case PREPARE_START:
+        sheet_data = eadk_external_data;
+        sheet_size = trailer_load(sheet_data, eadk_external_data_size);
+        prepare_stage = PREPARE_COUNT;
+        return 1;
+    case PREPARE_COUNT: {
+        size_t end = prepare_off + PREPARE_COUNT_CHUNK;
+        if (end > sheet_size) end = sheet_size;
+        for (; prepare_off < end; ++prepare_off) {
+            prepare_total_pixels += (((uint8_t)sheet_data[prepare_off] >> 4) & 0x0F) + 1;
+        }
+        if (prepare_off < sheet_size) return 1;
+        if (prepare_total_pixels == 0) {
+            prepare_stage = PREPARE_EMPTY;
+            return 0;
+        }
+        prepare_expected_lines = prepare_total_pixels / 320ULL;
+        prepare_stage = PREPARE_PLAN;
+        return 1;
+    }
+    case PREPARE_PLAN: {
+        if (!budget_plan(prepare_expected_lines)) {
+            prepare_stage = PREPARE_FAILED;
+            return 0;
+        }
+        /* The layout is only known for sure once the lines are indexed, but
+           our encoders record it in the trailer and older files are usually
+           whole 320x240 tiles, so guess it now and sample the overview during
+           the same walk. */
+        size_t early_cols = trailer_cols ? trailer_cols : square_cols(prepare_expected_lines);
+        if (early_cols) overview_begin(early_cols, prepare_expected_lines / early_cols);
+
+        /* To save RAM we don't store an offset per line. Instead store
+           sparse samples every sample_interval lines and scan on-demand. */
+        prepare_sample_slots = (prepare_expected_lines + sample_interval - 1) / sample_interval;
+        sheet_samples = (size_t*)malloc(prepare_sample_slots * sizeof(size_t));
+        if (!sheet_samples) {
+            prepare_stage = PREPARE_FAILED;
+            return 0;
+        }
+        prepare_off = 0;
+        prepare_line = 0;
+        prepare_stage = PREPARE_INDEX;
+        return 1;
+    }
+    case PREPARE_INDEX:
+        for (int n = 0; n < PREPARE_INDEX_CHUNK && prepare_off < sheet_size; ++n) {
+            size_t lb = line_bytes(sheet_data, sheet_size, prepare_off);
+            if (lb == 0) {
+                prepare_off = sheet_size;
+                break;
+            }
+            if ((prepare_line % sample_interval) == 0 && prepare_sample_idx < prepare_sample_slots) sheet_samples[prepare_sample_idx++] = prepare_off;
+            overview_add_line(sheet_data, sheet_size, prepare_off, prepare_line);
+            prepare_line++;
+            prepare_off += lb;
+        }
+        if (prepare_off < sheet_size) return 1;
+        if (prepare_line == 0) {
+            free(sheet_samples);
+            sheet_samples = NULL;
+            prepare_stage = PREPARE_EMPTY;
+            return 0;
+        }
+        prepare_stage = PREPARE_LAYOUT;
+        return 1;
+    case PREPARE_LAYOUT: {
+        size_t line_count = (prepare_line < prepare_expected_lines) ? prepare_line : prepare_expected_lines;
+        sheet_samples_count = prepare_sample_idx;
+
+        /* initialize scan hint now that samples_count is known */
+        if (sheet_samples_count > 0) {
+            scan_hint_idx = 0;
+            scan_hint_off = sheet_samples[0];
+            scan_hint_valid = 1;
+        } else {
+            scan_hint_idx = 0;
+            scan_hint_off = 0;
+            scan_hint_valid = 0;
+        }
+        shown_invalidate();
+
+        size_t cols = trailer_cols;
+        sheet_cols_source = VIEWER_COLS_TRAILER;
+        if (cols == 0 || line_count % cols != 0) {
+            cols = square_cols(line_count);
+            sheet_cols_source = VIEWER_COLS_SQUARE;
+        }
+        if (cols == 0) {
+            cols = guess_cols(sheet_data, sheet_size, line_count, sheet_samples, sheet_samples_count);
+            sheet_cols_source = VIEWER_COLS_GUESSED;
+        }
+        if (cols == 0) {
+            cols = 4;
+            sheet_cols_source = VIEWER_COLS_DEFAULT;
+        }
+
+        row_offsets = (size_t*)malloc(cols * sizeof(size_t));
+        if (!row_offsets) {
+            prepare_stage = PREPARE_FAILED;
+            return 0;
+        }
+        row_cache_init(cols);
+
+        if (cols != overview_cols || line_count / cols != overview_rows) overview_build(sheet_data, sheet_size, line_count, cols);
+
+        sheet_line_count = line_count;
+        sheet_cols = cols;
+        sheet_rows = line_count / cols;
+
+        build_source_y_lookup(0, VIEWER_FIRST_SCALE, sheet_rows);
+        prepare_row = 0;
+        prepare_stage = PREPARE_WARM_OFFSETS;
+        return 1;
+    }
+    case PREPARE_WARM_OFFSETS: {
+        int source_y = source_y_lookup[prepare_row];
+        if (source_y < (int)sheet_rows) source_row_offsets(source_y);
+        if (++prepare_row < 240) return 1;
+        prefetch_reset();
+        prefetch_view_x = 0;
+        prefetch_scale = VIEWER_FIRST_SCALE;
+        prepare_row = 0;
+        prepare_stage = PREPARE_WARM_ROWS;
+        return 1;
+    }
+    case PREPARE_WARM_ROWS: {
+        int j = prepare_row;
+        int source_y = source_y_lookup[j];
+        if (j < prefetch_rows && source_y < (int)sheet_rows) {
+            render_source_row(source_row_offsets(source_y), &prefetch_pixels[j * BUFFER_WIDTH], 0, VIEWER_FIRST_SCALE);
+            prefetch_source_y[j] = source_y;
+            if (source_y < prefetch_lo) prefetch_lo = source_y;
+            if (source_y > prefetch_hi) prefetch_hi = source_y;
+            prepare_row++;
+            return 1;
+        }
+        prepare_stage = PREPARE_DONE;
+        return 0;
+    }
+    default:
+        return 0;
+    }
+}
+
+int viewer_prepare_step(void) {
+#if VIEWER_DEBUG
+    /* startup is profiled as one frame; its row warming is counted in the
+       offsets and decode stages, and the cover screen's time between slices
+       is left out */
+    if (prepare_stage == PREPARE_START) profile_frame_begin();
+    profile_clock = eadk_timing_millis();
+    PROFILE_ENTER(prepare_stage < PREPARE_WARM_OFFSETS ? STAGE_INDEX : STAGE_OTHER);
+    int more = prepare_work();
+    PROFILE_LEAVE();
+    if (!more) profile_frame_end();
+    return more;
+#else
+    return prepare_work();
+#endif
+}
+
+/* Runs startup work for about budget_ms. Returns 0 once it is all done. */
+int viewer_prepare(uint32_t budget_ms) {
+    uint64_t deadline = eadk_timing_millis() + budget_ms;
+    while (viewer_prepare_step()) {
+        if (eadk_timing_millis() >= deadline) return 1;
+    }
+    return 0;
+}
+
+int viewer_status(void) {
+    switch (prepare_stage) {
+    case PREPARE_DONE:
+        return VIEWER_READY;
+    case PREPARE_EMPTY:
+        return VIEWER_EMPTY;
+    case PREPARE_FAILED:
+        return VIEWER_FAILED;
+    default:
+        return VIEWER_PREPARING;
+    }
+}
+
+int viewer_width(void) {
+    return (int)sheet_cols * 320;
+}
+
+int viewer_height(void) {
+    return (int)sheet_rows;
+}
+
+void viewer_get_stats(struct viewer_stats *stats) {
+    stats->frames = frames_done;
+    stats->rows_decoded = rows_decoded;
+    stats->bytes_decoded = bytes_decoded;
+    stats->rows_reused = screen_reuse_hits;
+    stats->rows_prefetched = prefetch_hits;
+    stats->prefetch_misses = prefetch_misses;
+    stats->offsets_hits = row_cache_hits;
+    stats->offsets_misses = row_cache_misses;
+    stats->band_height = band_height;
+    stats->sample_interval = sample_interval;
+    stats->row_cache_size = row_cache_size;
+    stats->prefetch_rows = prefetch_rows;
+    stats->line_count = sheet_line_count;
+    stats->cols = sheet_cols;
+    stats->cols_source = sheet_cols_source;
+}
+
+void viewer_free(void) {
+    free(sheet_samples);
+    free(row_offsets);
+    free(row_cache_keys);
+    free(row_cache_offsets);
+    free(prefetch_pixels);
+    free(line_buffer);
+    free(overview);
+}
+
+#if VIEWER_DEBUG
+/* Index, cache and budget statistics, then the stage times and traffic of
+   the last profiled frame, over the top left of the view. */
+void viewer_hud_draw(void) {
+    char buf[80];
+    int y = 2;
+    eadk_point_t p;
+    p.x = 2;
+    p.y = (uint16_t)y;
+    snprintf(buf, sizeof(buf), "total_pixels=%zu", prepare_total_pixels);
+    eadk_display_draw_string(buf, p, false, eadk_color_black, eadk_color_white);
+    y += 12; p.y = (uint16_t)y;
+    snprintf(buf, sizeof(buf), "expected_lines=%zu found_offsets=%zu", prepare_expected_lines, prepare_line);
+    eadk_display_draw_string(buf, p, false, eadk_color_black, eadk_color_white);
+    y += 12; p.y = (uint16_t)y;
+    snprintf(buf, sizeof(buf), "line_count=%zu cols=%zu rows=%zu", sheet_line_count, sheet_cols, sheet_rows);
+    eadk_display_draw_string(buf, p, false, eadk_color_black, eadk_color_white);
+    y += 12; p.y = (uint16_t)y;
+    snprintf(buf, sizeof(buf), "total_w=%d total_h=%d", (int)sheet_cols * 320, (int)sheet_rows);
+    eadk_display_draw_string(buf, p, false, eadk_color_black, eadk_color_white);
+    y += 12; p.y = (uint16_t)y;
+    snprintf(buf, sizeof(buf), "prefetch hit=%lu miss=%lu (%lu%%)", prefetch_hits, prefetch_misses,
+             prefetch_hits * 100 / (prefetch_hits + prefetch_misses + 1));
+    eadk_display_draw_string(buf, p, false, eadk_color_black, eadk_color_white);
+    y += 12; p.y = (uint16_t)y;
+    snprintf(buf, sizeof(buf), "rows reused=%lu prefetched=%lu decoded=%lu", screen_reuse_hits, prefetch_hits, rows_decoded);
+    eadk_display_draw_string(buf, p, false, eadk_color_black, eadk_color_white);
+    y += 12; p.y = (uint16_t)y;
+    snprintf(buf, sizeof(buf), "offsets hit=%lu miss=%lu (%lu%%)", row_cache_hits, row_cache_misses,
+             row_cache_hits * 100 / (row_cache_hits + row_cache_misses + 1));
+    eadk_display_draw_string(buf, p, false, eadk_color_black, eadk_color_white);
+    y += 12; p.y = (uint16_t)y;
+    snprintf(buf, sizeof(buf), "budget model=%u heap=%zuK band=%d sample=1/%zu",
+             budget_model, budget_heap / 1024, band_height, sample_interval);
+    eadk_display_draw_string(buf, p, false, eadk_color_black, eadk_color_white);
+    y += 12; p.y = (uint16_t)y;
+    snprintf(buf, sizeof(buf), "row cache=%zu prefetch=%d overview=%s",
+             row_cache_size, prefetch_rows, overview ? "yes" : "no");
+    eadk_display_draw_string(buf, p, false, eadk_color_black, eadk_color_white);
+    y += 12; p.y = (uint16_t)y;
+    const struct frame_profile *f = profile_last();
+    if (f) {
+        snprintf(buf, sizeof(buf), "frame %lu: idx=%lu off=%lu dec=%lu scl=%lu push=%lu ms",
+                 profile_frames - 1, (unsigned long)f->stage_ms[STAGE_INDEX],
+                 (unsigned long)f->stage_ms[STAGE_OFFSETS], (unsigned long)f->stage_ms[STAGE_DECODE],
+                 (unsigned long)f->stage_ms[STAGE_SCALE], (unsigned long)f->stage_ms[STAGE_PUSH]);
+        eadk_display_draw_string(buf, p, false, eadk_color_black, eadk_color_white);
+        y += 12; p.y = (uint16_t)y;
+        snprintf(buf, sizeof(buf), "scanned=%luB decoded=%luB pushes=%lu",
+                 (unsigned long)f->bytes_scanned, (unsigned long)f->bytes_decoded, (unsigned long)f->pushes);
+        eadk_display_draw_string(buf, p, false, eadk_color_black, eadk_color_white);
+        y += 12;
+    }
+    /* the rows under the overlay no longer show the frame */
+    for (int r = 0; r < y && r < 240; ++r) shown_source_y[r] = -1;
+}
+#endif
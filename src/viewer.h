@@ -0,0 +1,82 @@
+#ifndef VIEWER_H
+#define VIEWER_H
+
+#include "libs/eadk.h"
+
+/* set to 1 to profile the viewer: the var key toggles an overlay with index,
+   cache and per-stage statistics, and the last frames are saved as CSV */
+#ifndef VIEWER_DEBUG
+#define VIEWER_DEBUG 0
+#endif
+
+/* Cheatsheet viewer core: indexes the RLE sheet in the external data, then
+   renders views of it band by band. It only talks to the display and the
+   clock, so app.c drives it from the keyboard and the host bench drives it
+   from scripted scenarios. */
+
+enum { VIEWER_PREPARING, VIEWER_READY, VIEWER_EMPTY, VIEWER_FAILED };
+
+/* scale of the first view, whose rows are warmed during startup */
+#define VIEWER_FIRST_SCALE 4.0
+
+/* Startup work (index, memory budget, first frame), in bounded steps.
+   viewer_prepare_step() does one and returns 0 once there is nothing left;
+   viewer_prepare() runs them for about budget_ms. */
+int viewer_prepare_step(void);
+int viewer_prepare(uint32_t budget_ms);
+int viewer_status(void);
+int viewer_width(void);
+int viewer_height(void);
+
+/* The view to draw; viewer_jump() draws it in a single fine pass. Each
+   viewer_render_step() draws at most one band and returns 0 once the view
+   is fully refined. viewer_prefetch_step() then prepares one row for the
+   next pan, towards dir_y, and returns 0 when there is nothing left. */
+void viewer_set_view(int view_x, int view_y, double scale);
+void viewer_jump(int view_x, int view_y, double scale);
+int viewer_render_step(void);
+void viewer_prefetch_direction(int dir_y);
+int viewer_prefetch_step(void);
+
+double viewer_overview_scale(void);
+void viewer_overview_draw(void);
+void viewer_overview_as_frame(void);
+
+size_t viewer_hotspot_count(void);
+void viewer_hotspot_view(size_t h, int *view_x, int *view_y, double *scale);
+void viewer_hotspot_seed(size_t h, int view_y, double scale);
+
+/* where the number of columns came from: the trailer, a square sheet of
+   whole tiles, the comparison of neighbouring lines, or none of them */
+enum { VIEWER_COLS_TRAILER, VIEWER_COLS_SQUARE, VIEWER_COLS_GUESSED, VIEWER_COLS_DEFAULT };
+
+/* running totals since startup; frames counts views drawn to the end of
+   their fine pass */
+struct viewer_stats {
+    unsigned long frames;
+    unsigned long rows_decoded;
+    unsigned long bytes_decoded;
+    unsigned long rows_reused;
+    unsigned long rows_prefetched;
+    unsigned long prefetch_misses;
+    unsigned long offsets_hits;
+    unsigned long offsets_misses;
+    int band_height;
+    size_t sample_interval;
+    size_t row_cache_size;
+    int prefetch_rows;
+    size_t line_count;
+    size_t cols;
+    int cols_source;
+};
+void viewer_get_stats(struct viewer_stats *stats);
+
+#if VIEWER_DEBUG
+void viewer_hud_draw(void);
+void viewer_refresh(void);
+void viewer_profile_flush(void);
+#endif
+
+void viewer_free(void);
+
+#endif